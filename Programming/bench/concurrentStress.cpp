@@ -0,0 +1,208 @@
+//
+// ConcurrentRedBlackTree under readers and writers. uint32_t keys take the
+// optimistic (seqlock) path, string keys the reader-writer lock.
+//
+// First a correctness run: readers against a writer that never stops. Every
+// value a reader finds must be the one inserted with its key, and keys the
+// writer removed must be gone at the end. Optimistic readers wait out each
+// write, so with a writer that never pauses they get few reads in; the rates
+// below are the measurement.
+//
+// Then read throughput for a mostly-read mix (one write in WRITE_EVERY
+// operations) at 1, 2, 4 and 8 threads, next to a RedBlackTree behind one
+// mutex. Exits nonzero on a bad read
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrentRedBlackTree.h"
+
+using namespace std;
+
+const uint32_t
+    N_ITEMS = 200000,
+    N_READERS = 3,
+    WRITE_EVERY = 100;
+
+const double
+    RUN_SECONDS = 0.5;
+
+template <typename KeyType,typename MakeKey>
+bool stress(const char *name,MakeKey makeKey) {
+    // a small initial capacity, so the pool grows under the readers
+    ConcurrentRedBlackTree<KeyType,uint64_t>
+        t(2);
+    atomic<bool>
+        done(false);
+    atomic<uint64_t>
+        bad(0),
+        found(0);
+    vector<thread>
+        readers;
+
+    REPI(r,0,N_READERS)
+        readers.emplace_back([&,r] {
+            mt19937
+                mt(r);
+
+            while (!done) {
+                uint32_t
+                    k = mt() % N_ITEMS;
+
+                try {
+                    if (t.search(makeKey(k)) != 2ull * k)
+                        bad++;
+                    else
+                        found++;
+                } catch (domain_error &) { }
+
+                if (t.size() > N_ITEMS)
+                    bad++;
+            }
+        });
+
+    // every third key is removed right after it goes in
+    REPI(i,0,N_ITEMS) {
+        t.insert(makeKey(i),2ull * i);
+        if (i % 3 == 0)
+            t.remove(makeKey(i));
+    }
+
+    done = true;
+    for (auto &th : readers)
+        th.join();
+
+    REPI(i,0,N_ITEMS)
+        if (t.contains(makeKey(i)) != (i % 3 != 0))
+            bad++;
+
+    cout << name << ": " << found << " reads found, " << bad << " bad, size " << t.size() << endl;
+
+    return bad == 0;
+}
+
+// the tree as it's used today: every call behind one mutex
+template <typename KeyType>
+class LockedRedBlackTree {
+public:
+    uint64_t search(const KeyType &k) {
+        lock_guard<mutex>
+            g(lock);
+
+        return tree.search(k);
+    }
+
+    void insert(const KeyType &k,uint64_t v) {
+        lock_guard<mutex>
+            g(lock);
+
+        tree[k] = v;
+    }
+
+    void remove(const KeyType &k) {
+        lock_guard<mutex>
+            g(lock);
+
+        tree.remove(k);
+    }
+
+private:
+    RedBlackTree<KeyType,uint64_t>
+        tree;
+
+    mutex
+        lock;
+};
+
+// millions of reads per second over nThreads threads. reads look up even
+// keys, which are always present; each write puts an odd key in or takes it
+// out
+template <typename Tree,typename MakeKey>
+double readRate(uint32_t nThreads,MakeKey makeKey) {
+    Tree
+        t;
+    atomic<bool>
+        done(false);
+    atomic<uint64_t>
+        reads(0);
+    vector<thread>
+        threads;
+
+    REPI(i,0,N_ITEMS/2)
+        t.insert(makeKey(2 * i),2ull * i);
+
+    REPI(n,0,nThreads)
+        threads.emplace_back([&,n] {
+            mt19937
+                mt(n + 1);
+            uint64_t
+                myReads = 0,
+                sum = 0;
+
+            for (uint32_t op=1;!done;op++) {
+                uint32_t
+                    k = mt() % (N_ITEMS / 2);
+
+                if (op % WRITE_EVERY == 0) {
+                    try {
+                        t.remove(makeKey(2 * k + 1));
+                    } catch (domain_error &) {
+                        t.insert(makeKey(2 * k + 1),k);
+                    }
+                    continue;
+                }
+
+                sum += t.search(makeKey(2 * k));
+                myReads++;
+            }
+
+            // keep the searches from being optimized away
+            if (sum == 0)
+                cout << "";
+
+            reads += myReads;
+        });
+
+    this_thread::sleep_for(chrono::duration<double>(RUN_SECONDS));
+    done = true;
+    for (auto &th : threads)
+        th.join();
+
+    return reads / RUN_SECONDS / 1e6;
+}
+
+template <typename KeyType,typename MakeKey>
+void throughput(const char *name,MakeKey makeKey) {
+
+    cout << name << endl;
+    for (uint32_t n : {1,2,4,8})
+        cout << "  " << n << " thread" << ((n == 1) ? ": " : "s:") << setw(8)
+             << readRate<ConcurrentRedBlackTree<KeyType,uint64_t>>(n,makeKey) << " concurrent, " << setw(8)
+             << readRate<LockedRedBlackTree<KeyType>>(n,makeKey) << " one mutex" << endl;
+}
+
+int main() {
+    bool
+        ok = true;
+    auto
+        intKey = [](uint32_t k) { return k; };
+    auto
+        strKey = [](uint32_t k) { return to_string(k); };
+
+    ok &= stress<uint32_t>("uint32_t keys (optimistic)",intKey);
+    ok &= stress<string>("string keys (locked)",strKey);
+
+    cout << fixed << setprecision(2);
+    cout << "million reads per second, 1 write per " << WRITE_EVERY << " operations, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    throughput<uint32_t>("uint32_t keys (optimistic)",intKey);
+    throughput<string>("string keys (locked)",strKey);
+
+    return ok ? 0 : 1;
+}
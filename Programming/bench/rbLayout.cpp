@@ -0,0 +1,80 @@
+//
+// Search latency of RedBlackTree with split (one array per field) and
+// packed (hot key/link record + cold value record) node layouts
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include "redBlackTree.h"
+
+using namespace std;
+
+const uint32_t
+    N_ITEMS = 1048576,
+    N_SEARCHES = 4000000;
+
+template <typename KeyType,typename Layout>
+double timeSearches(KeyType *keys,uint32_t *probes) {
+    RedBlackTree<KeyType,uint32_t,RedBlackTreeCompare<KeyType>,Layout>
+        t;
+    uint64_t
+        sum = 0;
+
+    // insert in random order, so nodes are scattered in the pool
+    REPI(i,0,N_ITEMS)
+        t[keys[i]] = i;
+
+    auto
+        start = chrono::steady_clock::now();
+
+    REPI(i,0,N_SEARCHES)
+        sum += t.search(keys[probes[i]]);
+
+    auto
+        stop = chrono::steady_clock::now();
+
+    // keep the searches from being optimized away
+    if (sum == 0)
+        cout << "";
+
+    return chrono::duration<double,nano>(stop - start).count() / N_SEARCHES;
+}
+
+int main() {
+    auto
+        intKeys = new uint32_t[N_ITEMS];
+    auto
+        strKeys = new string[N_ITEMS];
+    auto
+        probes = new uint32_t[N_SEARCHES];
+    mt19937
+        mt(3700);
+    uniform_int_distribution<>
+        charDis(0,25);
+
+    REPI(i,0,N_ITEMS) {
+        intKeys[i] = mt();
+        REPI(j,0,8)
+            strKeys[i] += "abcdefghijklmnopqrstuvwxyz"[charDis(mt)];
+        strKeys[i] += to_string(i);
+    }
+
+    REPI(i,0,N_SEARCHES)
+        probes[i] = mt() % N_ITEMS;
+
+    cout << fixed << setprecision(1);
+    cout << "ns per search, " << N_ITEMS << " nodes" << endl;
+    cout << "  uint32_t keys, split:  " << timeSearches<uint32_t,SplitLayout>(intKeys,probes) << endl;
+    cout << "  uint32_t keys, packed: " << timeSearches<uint32_t,PackedLayout>(intKeys,probes) << endl;
+    cout << "  string keys, split:    " << timeSearches<string,SplitLayout>(strKeys,probes) << endl;
+    cout << "  string keys, packed:   " << timeSearches<string,PackedLayout>(strKeys,probes) << endl;
+
+    delete[] probes;
+    delete[] strKeys;
+    delete[] intKeys;
+
+    return 0;
+}
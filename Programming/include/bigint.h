@@ -0,0 +1,92 @@
+#include <cstdint>
+
+#ifndef _BIGINT_H
+#define _BIGINT_H
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// arbitrary precision signed integer, stored as sign and magnitude. the
+// magnitude is a little-endian vector of 32-bit limbs with no leading zero
+// limbs, so zero is an empty vector (and never negative)
+class BigInt {
+public:
+    BigInt() : neg(false) { }
+    BigInt(int v) { prvSet(v); }
+    BigInt(long v) { prvSet(v); }
+    BigInt(long long v) { prvSet(v); }
+    BigInt(__int128 v) { prvSet(v); }
+    explicit BigInt(const std::string &s);
+    BigInt(const BigInt &) = default;
+    BigInt(BigInt &&) = default;
+    ~BigInt() = default;
+
+    BigInt &operator=(const BigInt &) = default;
+    BigInt &operator=(BigInt &&) = default;
+
+    BigInt operator+(const BigInt &rhs) const;
+    BigInt operator-(const BigInt &rhs) const;
+    BigInt operator*(const BigInt &rhs) const;
+    BigInt operator/(const BigInt &rhs) const;
+    BigInt operator%(const BigInt &rhs) const;
+    BigInt operator-() const;
+
+    BigInt &operator+=(const BigInt &rhs) { return *this = *this + rhs; }
+    BigInt &operator-=(const BigInt &rhs) { return *this = *this - rhs; }
+    BigInt &operator*=(const BigInt &rhs) { return *this = *this * rhs; }
+    BigInt &operator/=(const BigInt &rhs) { return *this = *this / rhs; }
+    BigInt &operator%=(const BigInt &rhs) { return *this = *this % rhs; }
+
+    bool operator==(const BigInt &rhs) const { return neg == rhs.neg && mag == rhs.mag; }
+    bool operator!=(const BigInt &rhs) const { return !(*this == rhs); }
+    bool operator<=(const BigInt &rhs) const { return compare(rhs) <= 0; }
+    bool operator>=(const BigInt &rhs) const { return compare(rhs) >= 0; }
+    bool operator<(const BigInt &rhs) const { return compare(rhs) < 0; }
+    bool operator>(const BigInt &rhs) const { return compare(rhs) > 0; }
+
+    // negative, zero or positive as this is less than, equal to or greater
+    // than rhs
+    int compare(const BigInt &rhs) const;
+
+    // quotient truncated toward zero, remainder with the dividend's sign;
+    // throws domain_error on division by zero
+    static void divMod(const BigInt &a,const BigInt &b,BigInt &q,BigInt &r);
+
+    bool isZero() const { return mag.empty(); }
+    bool isNegative() const { return neg; }
+
+    // false if the value doesn't fit in the result
+    bool toInt128(__int128 &out) const;
+
+    std::string toString() const;
+
+    // equal values hash alike; the limbs are folded, not finely mixed
+    uint64_t hash() const;
+
+private:
+    bool
+        neg;
+    std::vector<uint32_t>
+        mag;
+
+    void prvSet(__int128 v);
+    void prvTrim();
+
+    static int prvCompareMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b);
+    static void prvAddMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                          std::vector<uint32_t> &out);
+    static void prvSubMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                          std::vector<uint32_t> &out);
+    static void prvDivModMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                             std::vector<uint32_t> &q,std::vector<uint32_t> &r);
+};
+
+BigInt abs(const BigInt &a);
+BigInt gcd(BigInt a,BigInt b);
+
+std::istream &operator>>(std::istream &,BigInt &);
+std::ostream &operator<<(std::ostream &,const BigInt &);
+
+#endif
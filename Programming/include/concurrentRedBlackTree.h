@@ -0,0 +1,234 @@
+//
+// Red-black tree for many readers and few writers. Writers take turns
+// through a mutex; readers never lock. Each write makes a sequence number
+// odd while it runs and even again when it's done, and a reader retries its
+// descent if the number was odd or changed while it read (a seqlock).
+//
+// A reader can see a tree in the middle of a change, so it bounds every
+// index and the length of its descent, and the pool keeps old node arrays
+// after growing. Everything a reader touches (the root, the capacity, the
+// array pointers, and the links, counts, keys and values of the nodes) is
+// read with atomic loads and written by the tree with atomic stores. This
+// is only safe when keys and values are trivially copyable; for other
+// types readers share a reader-writer lock instead.
+//
+// Readers wait while the number is odd, so a write keeps it odd for as
+// short a time as it can: the pool grows, if it must, before the write
+// starts.
+//
+
+#ifndef CONCURRENTREDBLACKTREE_H
+#define CONCURRENTREDBLACKTREE_H
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include "redBlackTree.h"
+
+static const uint32_t
+    MAX_OPTIMISTIC_DEPTH = 128;     // no valid tree with 32-bit indices is this tall
+
+template <typename KeyType,typename ValueType,typename Compare=RedBlackTreeCompare<KeyType>,
+          typename Layout=SplitLayout>
+class ConcurrentRedBlackTree {
+public:
+    static constexpr bool
+        optimistic = std::is_trivially_copyable<KeyType>::value &&
+                     std::is_trivially_copyable<ValueType>::value;
+
+    explicit ConcurrentRedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY,const Compare &_cmp=Compare()) :
+        tree(_cap,_cmp),seq(0) {
+
+        tree.pool->keepRetired = optimistic;
+    }
+
+    ValueType search(const KeyType &k) {
+        ValueType
+            v;
+
+        auto
+            got = [&](uint32_t r) {
+                if constexpr (optimistic)
+                    relaxedLoad(v,tree.pool->store.valueAddress(r));
+                else
+                    v = tree.values(r);
+            };
+
+        if (!read(got,k))
+            throw std::domain_error("Search: Key not found");
+
+        return v;
+    }
+
+    bool contains(const KeyType &k) {
+
+        return read([](uint32_t) { },k);
+    }
+
+    uint32_t size() {
+
+        if constexpr (optimistic) {
+            for (;;) {
+                uint32_t
+                    s = beginRead(),
+                    cap = readCapacity(),
+                    r = readRoot(),
+                    n = (r < cap) ? tree.pool->store.loadCount(r) : 0;
+
+                if (endRead(s))
+                    return n;
+            }
+        } else {
+            std::shared_lock<std::shared_mutex>
+                lock(rwLock);
+
+            return tree.size();
+        }
+    }
+
+    bool isEmpty() { return size() == 0; }
+
+    void insert(const KeyType &k,const ValueType &v) {
+        WriteGuard
+            g(*this,true);
+
+        tree.emplace(k,v);
+    }
+
+    void remove(const KeyType &k) {
+        WriteGuard
+            g(*this);
+
+        tree.remove(k);
+    }
+
+    void clear() {
+        WriteGuard
+            g(*this);
+
+        tree.clear();
+    }
+
+private:
+    // serializes writers and, for the whole write, makes the sequence
+    // number odd (or holds the reader-writer lock exclusively). for a write
+    // that may need a new node, an optimistic pool makes room for it first
+    struct WriteGuard {
+        explicit WriteGuard(ConcurrentRedBlackTree &_t,bool allocates=false) : t(_t) {
+
+            t.writeLock.lock();
+
+            if constexpr (optimistic) {
+                if (allocates)
+                    t.tree.pool->reserve();
+                t.seq.store(t.seq.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            } else
+                t.rwLock.lock();
+        }
+
+        ~WriteGuard() {
+
+            if constexpr (optimistic)
+                t.seq.store(t.seq.load(std::memory_order_relaxed) + 1,std::memory_order_release);
+            else
+                t.rwLock.unlock();
+
+            t.writeLock.unlock();
+        }
+
+        ConcurrentRedBlackTree
+            &t;
+    };
+
+    uint32_t beginRead() {
+        uint32_t
+            s;
+
+        while ((s = seq.load(std::memory_order_acquire)) & 1)
+            std::this_thread::yield();
+
+        return s;
+    }
+
+    bool endRead(uint32_t s) {
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return seq.load(std::memory_order_relaxed) == s;
+    }
+
+    // reading the capacity before the node arrays means any index below it
+    // is inside whichever arrays are seen
+    uint32_t readCapacity() { return __atomic_load_n(&tree.pool->capacity,__ATOMIC_ACQUIRE); }
+
+    uint32_t readRoot() { return __atomic_load_n(&tree.root,__ATOMIC_RELAXED); }
+
+    // find k and, if found, hand its node to got() while the read is still
+    // valid; returns whether k was found
+    template <typename Fn>
+    bool read(Fn got,const KeyType &k) {
+
+        if constexpr (optimistic) {
+            for (;;) {
+                uint32_t
+                    s = beginRead(),
+                    cap = readCapacity(),
+                    r = readRoot(),
+                    depth = 0;
+                int
+                    c = 1;
+                KeyType
+                    key;
+
+                // compare against a copy, so the comparator never reads a
+                // key while it's being written
+                while (r < cap && depth++ < MAX_OPTIMISTIC_DEPTH) {
+                    relaxedLoad(key,tree.pool->store.keyAddress(r));
+                    c = tree.cmp(k,key);
+                    if (c == 0)
+                        break;
+                    r = (c < 0) ? tree.pool->store.loadLeft(r) : tree.pool->store.loadRight(r);
+                }
+
+                // anything read during a write is thrown away and read again
+                if (c == 0 && r < cap)
+                    got(r);
+                if (!endRead(s))
+                    continue;
+
+                if (c == 0 && r < cap)
+                    return true;
+                if (r == NULL_INDEX)
+                    return false;
+            }
+        } else {
+            std::shared_lock<std::shared_mutex>
+                lock(rwLock);
+
+            try {
+                got(tree.prvFind(tree.root,k));
+            } catch (const std::domain_error &e) {
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    RedBlackTree<KeyType,ValueType,Compare,Layout>
+        tree;
+
+    std::atomic<uint32_t>
+        seq;
+
+    std::mutex
+        writeLock;
+
+    std::shared_mutex
+        rwLock;
+};
+
+#endif //CONCURRENTREDBLACKTREE_H
@@ -3,37 +3,712 @@
 #ifndef _FRACTION_H
 #define _FRACTION_H
 
+#include <charconv>
 #include <iostream>
+#include <stdexcept>
+#include "bigint.h"
 
-class Fraction {
+// integer type that holds the product of two IntTypes. __int128 has nothing
+// wider and BigInt doesn't need it, so for those the products are checked
+template <typename IntType> struct FractionWide { typedef IntType type; };
+template <> struct FractionWide<int32_t> { typedef int64_t type; };
+template <> struct FractionWide<int64_t> { typedef __int128 type; };
+
+// checked arithmetic on intermediates. built-in types throw overflow_error
+// when a result doesn't fit; BigInt can't overflow, so its overloads are
+// plain arithmetic
+
+// true if a + b or a * b doesn't fit, leaving the result in r otherwise
+template <typename T>
+constexpr bool fractionAddOverflows(T a,T b,T &r) { return __builtin_add_overflow(a,b,&r); }
+template <typename T>
+constexpr bool fractionMulOverflows(T a,T b,T &r) { return __builtin_mul_overflow(a,b,&r); }
+
+template <typename T>
+constexpr T fractionAdd(T a,T b) {
+    T
+        r = 0;
+
+    if (__builtin_add_overflow(a,b,&r))
+        throw std::overflow_error("Fraction: overflow");
+
+    return r;
+}
+
+template <typename T>
+constexpr T fractionSub(T a,T b) {
+    T
+        r = 0;
+
+    if (__builtin_sub_overflow(a,b,&r))
+        throw std::overflow_error("Fraction: overflow");
+
+    return r;
+}
+
+template <typename T>
+constexpr T fractionMul(T a,T b) {
+    T
+        r = 0;
+
+    if (__builtin_mul_overflow(a,b,&r))
+        throw std::overflow_error("Fraction: overflow");
+
+    return r;
+}
+
+inline bool fractionAddOverflows(const BigInt &a,const BigInt &b,BigInt &r) { r = a + b; return false; }
+inline bool fractionMulOverflows(const BigInt &a,const BigInt &b,BigInt &r) { r = a * b; return false; }
+inline BigInt fractionAdd(const BigInt &a,const BigInt &b) { return a + b; }
+inline BigInt fractionSub(const BigInt &a,const BigInt &b) { return a - b; }
+inline BigInt fractionMul(const BigInt &a,const BigInt &b) { return a * b; }
+inline BigInt fractionGcd(const BigInt &a,const BigInt &b) { return gcd(a,b); }
+
+// sign of a*b - c*d for b,d > 0, found by cross multiplication alone.
+// built-in types multiply in FractionWide, which can't overflow
+template <typename T>
+constexpr int fractionCompareCross(T a,T b,T c,T d) {
+    typedef typename FractionWide<T>::type W;
+    W
+        l = (W)a * b,
+        r = (W)c * d;
+
+    return (l < r) ? -1 : (l > r);
+}
+
+// __int128 has nothing wider: when a product overflows, compare the exact
+// 256-bit products of the magnitudes instead
+constexpr void fractionMul256(unsigned __int128 x,unsigned __int128 y,
+                              unsigned __int128 &hi,unsigned __int128 &lo) {
+    typedef unsigned __int128 U;
+    U
+        x0 = (uint64_t)x,
+        x1 = x >> 64,
+        y0 = (uint64_t)y,
+        y1 = y >> 64,
+        p00 = x0 * y0,
+        p01 = x0 * y1,
+        p10 = x1 * y0,
+        mid = (p00 >> 64) + (uint64_t)p01 + (uint64_t)p10;
+
+    lo = (U)(uint64_t)p00 | (mid << 64);
+    hi = x1 * y1 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+}
+
+constexpr int fractionCompareCross(__int128 a,__int128 b,__int128 c,__int128 d) {
+    typedef unsigned __int128 U;
+    __int128
+        l = 0,
+        r = 0;
+    U
+        lh = 0,
+        ll = 0,
+        rh = 0,
+        rl = 0;
+    int
+        sa = (a > 0) - (a < 0),
+        sc = (c > 0) - (c < 0),
+        m = 0;
+
+    if (!__builtin_mul_overflow(a,b,&l) && !__builtin_mul_overflow(c,d,&r))
+        return (l < r) ? -1 : (l > r);
+
+    // an overflowing product is nonzero, so one with a different sign
+    // settles it
+    if (sa != sc)
+        return (sa < sc) ? -1 : 1;
+
+    fractionMul256((a < 0) ? -(U)a : (U)a,(U)b,lh,ll);
+    fractionMul256((c < 0) ? -(U)c : (U)c,(U)d,rh,rl);
+    m = (lh != rh) ? ((lh < rh) ? -1 : 1) : ((ll < rl) ? -1 : (ll > rl));
+
+    return (sa < 0) ? -m : m;
+}
+
+inline int fractionCompareCross(const BigInt &a,const BigInt &b,const BigInt &c,const BigInt &d) {
+    return (a * b).compare(c * d);
+}
+
+// narrow a wide intermediate back to the fraction's type
+template <typename T,typename W>
+constexpr T fractionNarrow(const W &w) {
+    T
+        t = (T)w;
+
+    if ((W)t != w)
+        throw std::overflow_error("Fraction: overflow");
+
+    return t;
+}
+
+// Stein's binary gcd on magnitudes: shifts and subtractions instead of a
+// division per step
+template <typename T> struct FractionUnsigned;
+template <> struct FractionUnsigned<int32_t> { typedef uint32_t type; };
+template <> struct FractionUnsigned<int64_t> { typedef uint64_t type; };
+template <> struct FractionUnsigned<__int128> { typedef unsigned __int128 type; };
+
+constexpr int fractionCtz(uint32_t x) { return __builtin_ctz(x); }
+constexpr int fractionCtz(uint64_t x) { return __builtin_ctzll(x); }
+constexpr int fractionCtz(unsigned __int128 x) {
+    return ((uint64_t)x != 0) ? __builtin_ctzll((uint64_t)x) : 64 + __builtin_ctzll((uint64_t)(x >> 64));
+}
+
+template <typename T>
+constexpr T fractionGcd(T a,T b) {
+    typedef typename FractionUnsigned<T>::type U;
+    U
+        x = (a < 0) ? -(U)a : (U)a,
+        y = (b < 0) ? -(U)b : (U)b,
+        t = 0;
+    int
+        shift = 0;
+
+    if (x == 0)
+        return (T)y;
+    if (y == 0)
+        return (T)x;
+
+    shift = fractionCtz(x | y);
+    x >>= fractionCtz(x);
+
+    // x stays odd; strip y's twos and subtract the smaller from the larger
+    do {
+        y >>= fractionCtz(y);
+        if (x > y) {
+            t = x;
+            x = y;
+            y = t;
+        }
+        y -= x;
+    } while (y != 0);
+
+    return (T)(x << shift);
+}
+
+// hashing: fold each part to 64 bits, combine, then run murmur3's finalizer
+// so that neighbouring fractions land far apart
+constexpr uint64_t fractionMix(uint64_t x) {
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+
+    return x;
+}
+
+constexpr uint64_t fractionHashPart(int32_t v) { return (uint32_t)v; }
+constexpr uint64_t fractionHashPart(int64_t v) { return (uint64_t)v; }
+constexpr uint64_t fractionHashPart(__int128 v) {
+    return (uint64_t)v ^ fractionMix((uint64_t)((unsigned __int128)v >> 64));
+}
+inline uint64_t fractionHashPart(const BigInt &v) { return v.hash(); }
+
+// fraction kept in lowest terms with a positive denominator. sums and
+// products are formed in FractionWide<IntType>, so the only overflow
+// possible is a reduced result that doesn't fit in IntType, which throws
+// overflow_error instead of wrapping; comparisons never throw. arithmetic
+// cancels common factors of the operands before multiplying (Knuth, TAOCP
+// 4.5.1), which keeps the intermediates small and leaves results already in
+// lowest terms. all but the stream operators are constexpr and defined here,
+// so fractions of built-in types can be computed at compile time and inlined
+// by callers
+template <typename IntType>
+class BasicFraction {
 public:
-     Fraction(int32_t n=0,int32_t d=1);
-    ~Fraction() = default;
+    typedef typename FractionWide<IntType>::type WideType;
 
-    Fraction operator=(Fraction rhs);
+    constexpr BasicFraction() : num(0),den(1) { }
+    constexpr BasicFraction(IntType n,IntType d=1) : BasicFraction(prvMake(n,d)) { }
+    BasicFraction(const BasicFraction &) = default;
+    BasicFraction(BasicFraction &&) = default;
+    ~BasicFraction() = default;
 
-    Fraction operator+(Fraction rhs) ;
-    Fraction operator-(Fraction rhs) ;
-    Fraction operator*(Fraction rhs) ;
-    Fraction operator/(Fraction rhs) ;
+    BasicFraction &operator=(const BasicFraction &) = default;
+    BasicFraction &operator=(BasicFraction &&) = default;
 
-    bool operator==(Fraction rhs) ;
-    bool operator!=(Fraction rhs) ;
-    bool operator<=(Fraction rhs) ;
-    bool operator>=(Fraction rhs) ;
-    bool operator<(Fraction rhs) ;
-    bool operator>(Fraction rhs) ;
+    constexpr BasicFraction operator+(const BasicFraction &rhs) const;
+    constexpr BasicFraction operator-(const BasicFraction &rhs) const;
+    constexpr BasicFraction operator*(const BasicFraction &rhs) const;
+    constexpr BasicFraction operator/(const BasicFraction &rhs) const;
 
-    [[nodiscard]] int32_t getNum() const { return num; }
-    [[nodiscard]] int32_t getDen() const { return den; }
+    // an integer operand is k/1 already in lowest terms, so these skip the
+    // constructor's gcd, and + and - need no gcd at all
+    constexpr BasicFraction operator+(IntType k) const;
+    constexpr BasicFraction operator-(IntType k) const;
+    constexpr BasicFraction operator*(IntType k) const;
+    constexpr BasicFraction operator/(IntType k) const;
+
+    friend constexpr BasicFraction operator+(IntType k,const BasicFraction &f) { return f + k; }
+    friend constexpr BasicFraction operator*(IntType k,const BasicFraction &f) { return f * k; }
+    friend constexpr BasicFraction operator-(IntType k,const BasicFraction &f) {
+        return prvFit(fractionSub(fractionMul((WideType)k,(WideType)f.den),(WideType)f.num),f.den);
+    }
+    friend constexpr BasicFraction operator/(IntType k,const BasicFraction &f) {
+        return BasicFraction(k,1,Reduced()) / f;
+    }
+
+    constexpr BasicFraction &operator+=(const BasicFraction &rhs) { return *this = *this + rhs; }
+    constexpr BasicFraction &operator-=(const BasicFraction &rhs) { return *this = *this - rhs; }
+    constexpr BasicFraction &operator*=(const BasicFraction &rhs) { return *this = *this * rhs; }
+    constexpr BasicFraction &operator/=(const BasicFraction &rhs) { return *this = *this / rhs; }
+    constexpr BasicFraction &operator+=(IntType k) { return *this = *this + k; }
+    constexpr BasicFraction &operator-=(IntType k) { return *this = *this - k; }
+    constexpr BasicFraction &operator*=(IntType k) { return *this = *this * k; }
+    constexpr BasicFraction &operator/=(IntType k) { return *this = *this / k; }
+
+    constexpr bool operator==(const BasicFraction &rhs) const;
+    constexpr bool operator!=(const BasicFraction &rhs) const;
+    constexpr bool operator<=(const BasicFraction &rhs) const;
+    constexpr bool operator>=(const BasicFraction &rhs) const;
+    constexpr bool operator<(const BasicFraction &rhs) const;
+    constexpr bool operator>(const BasicFraction &rhs) const;
+
+    // negative, zero or positive as *this is less than, equal to or greater
+    // than rhs. no gcds and no reductions: signs, then a cross multiplication
+    [[nodiscard]] constexpr int compare(const BasicFraction &rhs) const;
+
+    // fractions are always in lowest terms, so equal fractions have equal
+    // parts and hash alike
+    [[nodiscard]] constexpr uint64_t hash() const {
+        return fractionMix(fractionHashPart(num) + 0x9e3779b97f4a7c15ull * fractionHashPart(den));
+    }
+
+    [[nodiscard]] constexpr IntType getNum() const { return num; }
+    [[nodiscard]] constexpr IntType getDen() const { return den; }
 
 private:
+    template <typename> friend class BasicFractionSum;
+
+    IntType
+            num,
+            den;
+
+    // parts already in lowest terms
+    struct Reduced { };
+    constexpr BasicFraction(IntType n,IntType d,Reduced) : num(n),den(d) { }
+
+    // reduce n/d and narrow it to IntType
+    static constexpr BasicFraction prvMake(WideType n,WideType d);
+
+    // narrow n/d, which must already be in lowest terms with d > 0
+    static constexpr BasicFraction prvFit(const WideType &n,const WideType &d);
+};
+
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::prvMake(WideType n,WideType d) {
+    WideType
+        g = 0;
+
+    if (d == 0)
+        throw std::domain_error("Fraction: zero denominator");
+
+    if (d < 0) {
+        n = fractionSub((WideType)0,n);
+        d = fractionSub((WideType)0,d);
+    }
+
+    g = fractionGcd(n,d);
+
+    return BasicFraction(fractionNarrow<IntType>(WideType(n / g)),
+                         fractionNarrow<IntType>(WideType(d / g)),Reduced());
+}
+
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::prvFit(const WideType &n,const WideType &d) {
+
+    return BasicFraction(fractionNarrow<IntType>(n),fractionNarrow<IntType>(d),Reduced());
+}
+
+// a/b + c/d: with d1 = gcd(b,d), the sum is (a*(d/d1) + c*(b/d1)) / (b*(d/d1)),
+// and the only factors that can still cancel divide d1 as well
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator+(const BasicFraction &rhs) const {
+    IntType
+        d1 = fractionGcd(den,rhs.den);
+    WideType
+        t = 0,
+        d2 = 0;
+
+    if (d1 == 1)
+        return prvFit(fractionAdd(fractionMul((WideType)num,(WideType)rhs.den),
+                                 fractionMul((WideType)rhs.num,(WideType)den)),
+                      fractionMul((WideType)den,(WideType)rhs.den));
+
+    t = fractionAdd(fractionMul((WideType)num,(WideType)(rhs.den / d1)),
+                   fractionMul((WideType)rhs.num,(WideType)(den / d1)));
+    if (t == 0)
+        return BasicFraction();
+    d2 = fractionGcd(t,(WideType)d1);
+
+    return prvFit(WideType(t / d2),fractionMul((WideType)(den / d1),WideType(rhs.den / d2)));
+}
+
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator-(const BasicFraction &rhs) const {
+    IntType
+        d1 = fractionGcd(den,rhs.den);
+    WideType
+        t = 0,
+        d2 = 0;
+
+    if (d1 == 1)
+        return prvFit(fractionSub(fractionMul((WideType)num,(WideType)rhs.den),
+                                 fractionMul((WideType)rhs.num,(WideType)den)),
+                      fractionMul((WideType)den,(WideType)rhs.den));
+
+    t = fractionSub(fractionMul((WideType)num,(WideType)(rhs.den / d1)),
+                   fractionMul((WideType)rhs.num,(WideType)(den / d1)));
+    if (t == 0)
+        return BasicFraction();
+    d2 = fractionGcd(t,(WideType)d1);
+
+    return prvFit(WideType(t / d2),fractionMul((WideType)(den / d1),WideType(rhs.den / d2)));
+}
+
+// a/b * c/d: cancel gcd(a,d) and gcd(c,b) first; what's left is coprime
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator*(const BasicFraction &rhs) const {
+    IntType
+        g1 = 0,
+        g2 = 0;
+
+    if (num == 0 || rhs.num == 0)
+        return BasicFraction();
+
+    g1 = fractionGcd(num,rhs.den);
+    g2 = fractionGcd(rhs.num,den);
+
+    return prvFit(fractionMul((WideType)(num / g1),(WideType)(rhs.num / g2)),
+                  fractionMul((WideType)(den / g2),(WideType)(rhs.den / g1)));
+}
+
+// a/b / c/d = a*d / b*c: cancel gcd(a,c) and gcd(d,b), then move c's sign up
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator/(const BasicFraction &rhs) const {
+    IntType
+        g1 = 0,
+        g2 = 0;
+    WideType
+        n = 0,
+        d = 0;
+
+    if (rhs.num == 0)
+        throw std::domain_error("Fraction: division by zero");
+
+    if (num == 0)
+        return BasicFraction();
+
+    g1 = fractionGcd(num,rhs.num);
+    g2 = fractionGcd(rhs.den,den);
+    n = fractionMul((WideType)(num / g1),(WideType)(rhs.den / g2));
+    d = fractionMul((WideType)(den / g2),(WideType)(rhs.num / g1));
+
+    if (d < 0) {
+        n = fractionSub((WideType)0,n);
+        d = fractionSub((WideType)0,d);
+    }
+
+    return prvFit(n,d);
+}
+
+// a/b + k = (a + k*b) / b, and gcd(a + k*b,b) = gcd(a,b) = 1
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator+(IntType k) const {
+
+    return prvFit(fractionAdd((WideType)num,fractionMul((WideType)k,(WideType)den)),den);
+}
+
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator-(IntType k) const {
+
+    return prvFit(fractionSub((WideType)num,fractionMul((WideType)k,(WideType)den)),den);
+}
+
+// a/b * k: only gcd(k,b) can cancel
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator*(IntType k) const {
+    IntType
+        g = 0;
+
+    if (num == 0 || k == 0)
+        return BasicFraction();
+
+    g = fractionGcd(k,den);
+
+    return prvFit(fractionMul((WideType)num,(WideType)(k / g)),(WideType)(den / g));
+}
+
+// a/b / k: only gcd(a,k) can cancel; k's sign moves up
+template <typename IntType>
+constexpr BasicFraction<IntType> BasicFraction<IntType>::operator/(IntType k) const {
+    IntType
+        g = 0;
+    WideType
+        n = 0,
+        d = 0;
+
+    if (k == 0)
+        throw std::domain_error("Fraction: division by zero");
+
+    if (num == 0)
+        return BasicFraction();
+
+    g = fractionGcd(num,k);
+    n = (WideType)(num / g);
+    d = fractionMul((WideType)den,(WideType)(k / g));
+
+    if (d < 0) {
+        n = fractionSub((WideType)0,n);
+        d = fractionSub((WideType)0,d);
+    }
+
+    return prvFit(n,d);
+}
+
+// both are in lowest terms with positive denominators, so equal fractions
+// have equal parts
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator==(const BasicFraction &rhs) const {
+
+    return num == rhs.num && den == rhs.den;
+}
+
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator!=(const BasicFraction &rhs) const {
+
+    return num != rhs.num || den != rhs.den;
+}
+
+template <typename IntType>
+constexpr int BasicFraction<IntType>::compare(const BasicFraction &rhs) const {
     int
+        s = (num > IntType(0)) - (num < IntType(0)),
+        rs = (rhs.num > IntType(0)) - (rhs.num < IntType(0));
+
+    if (s != rs)
+        return (s < rs) ? -1 : 1;
+
+    if (s == 0)
+        return 0;
+
+    if (den == rhs.den)
+        return (num < rhs.num) ? -1 : (num > rhs.num);
+
+    return fractionCompareCross(num,rhs.den,rhs.num,den);
+}
+
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator<=(const BasicFraction &rhs) const {
+
+    return compare(rhs) <= 0;
+}
+
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator>=(const BasicFraction &rhs) const {
+
+    return compare(rhs) >= 0;
+}
+
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator<(const BasicFraction &rhs) const {
+
+    return compare(rhs) < 0;
+}
+
+template <typename IntType>
+constexpr bool BasicFraction<IntType>::operator>(const BasicFraction &rhs) const {
+
+    return compare(rhs) > 0;
+}
+
+// running total that skips the gcd per addition: terms are cross-added into
+// an unreduced FractionWide numerator and denominator, and the total is only
+// reduced when the next term would overflow them, or when value() reads it.
+// summing n terms this way costs a few gcds instead of n. throws
+// overflow_error only if even the reduced total can't take the next term
+template <typename IntType>
+class BasicFractionSum {
+public:
+    typedef typename BasicFraction<IntType>::WideType WideType;
+
+    constexpr BasicFractionSum() : num(0),den(1) { }
+    constexpr BasicFractionSum(const BasicFraction<IntType> &f) : num(f.num),den(f.den) { }
+    ~BasicFractionSum() = default;
+
+    constexpr BasicFractionSum &operator+=(const BasicFraction<IntType> &f);
+    constexpr BasicFractionSum &operator-=(const BasicFraction<IntType> &f);
+
+    // the total, in lowest terms; throws overflow_error if it doesn't fit
+    [[nodiscard]] constexpr BasicFraction<IntType> value() const {
+        return BasicFraction<IntType>::prvMake(num,den);
+    }
+
+    constexpr void clear() {
+        num = 0;
+        den = 1;
+    }
+
+private:
+    WideType
             num,
             den;
+
+    // num/den += n/d, d > 0
+    constexpr void prvAdd(const WideType &n,const WideType &d);
+
+    // num/den += n/d unless it would overflow; false if it would
+    constexpr bool prvTryAdd(const WideType &n,const WideType &d);
+
+    constexpr void prvNormalize();
+};
+
+template <typename IntType>
+constexpr BasicFractionSum<IntType> &BasicFractionSum<IntType>::operator+=(const BasicFraction<IntType> &f) {
+
+    prvAdd(f.num,f.den);
+
+    return *this;
+}
+
+template <typename IntType>
+constexpr BasicFractionSum<IntType> &BasicFractionSum<IntType>::operator-=(const BasicFraction<IntType> &f) {
+
+    prvAdd(fractionSub((WideType)0,(WideType)f.num),f.den);
+
+    return *this;
+}
+
+template <typename IntType>
+constexpr void BasicFractionSum<IntType>::prvAdd(const WideType &n,const WideType &d) {
+
+    if (prvTryAdd(n,d))
+        return;
+
+    prvNormalize();
+
+    if (!prvTryAdd(n,d))
+        throw std::overflow_error("Fraction: overflow");
+}
+
+// terms over the same denominator, the usual case for a run of like terms,
+// add without touching it
+template <typename IntType>
+constexpr bool BasicFractionSum<IntType>::prvTryAdd(const WideType &n,const WideType &d) {
+    WideType
+        a = 0,
+        b = 0,
+        t = 0,
+        dd = 0;
+
+    if (d == den) {
+        if (fractionAddOverflows(num,n,t))
+            return false;
+        num = t;
+        return true;
+    }
+
+    if (fractionMulOverflows(num,d,a) || fractionMulOverflows(n,den,b) ||
+        fractionAddOverflows(a,b,t) || fractionMulOverflows(den,d,dd))
+        return false;
+
+    num = t;
+    den = dd;
+
+    return true;
+}
+
+template <typename IntType>
+constexpr void BasicFractionSum<IntType>::prvNormalize() {
+    WideType
+        g = fractionGcd(num,den);
+
+    if (g != 1) {
+        num = num / g;
+        den = den / g;
+    }
+}
+
+typedef BasicFraction<int32_t> Fraction;
+typedef BasicFraction<int64_t> Fraction64;
+typedef BasicFraction<__int128> Fraction128;
+typedef BasicFraction<BigInt> BigFraction;
+
+typedef BasicFractionSum<int32_t> FractionSum;
+typedef BasicFractionSum<int64_t> FractionSum64;
+
+// lets fractions key std::unordered_map and HashDictionary
+namespace std {
+template <typename IntType>
+struct hash<BasicFraction<IntType>> {
+    size_t operator()(const BasicFraction<IntType> &f) const noexcept { return (size_t)f.hash(); }
 };
+}
+
+// exact fraction that does its arithmetic as a Fraction64 until a result
+// doesn't fit, then as a BigFraction. results that fit in 64 bits again go
+// back to the fast representation
+class ExactFraction {
+public:
+    ExactFraction(int64_t n=0,int64_t d=1) : small(n,d),isBig(false) { }
+    ExactFraction(const Fraction64 &f) : small(f),isBig(false) { }
+    ExactFraction(const BigFraction &f);
+    ExactFraction(const ExactFraction &) = default;
+    ExactFraction(ExactFraction &&) = default;
+    ~ExactFraction() = default;
+
+    ExactFraction &operator=(const ExactFraction &) = default;
+    ExactFraction &operator=(ExactFraction &&) = default;
+
+    ExactFraction operator+(const ExactFraction &rhs) const;
+    ExactFraction operator-(const ExactFraction &rhs) const;
+    ExactFraction operator*(const ExactFraction &rhs) const;
+    ExactFraction operator/(const ExactFraction &rhs) const;
+
+    bool operator==(const ExactFraction &rhs) const;
+    bool operator!=(const ExactFraction &rhs) const;
+    bool operator<=(const ExactFraction &rhs) const;
+    bool operator>=(const ExactFraction &rhs) const;
+    bool operator<(const ExactFraction &rhs) const;
+    bool operator>(const ExactFraction &rhs) const;
+
+    [[nodiscard]] BigInt getNum() const { return isBig ? big.getNum() : BigInt(small.getNum()); }
+    [[nodiscard]] BigInt getDen() const { return isBig ? big.getDen() : BigInt(small.getDen()); }
+
+    // true once the value has outgrown 64 bits
+    [[nodiscard]] bool isPromoted() const { return isBig; }
+
+    [[nodiscard]] BigFraction toBig() const;
+
+private:
+    Fraction64
+            small;
+    BigFraction
+            big;
+    bool
+            isBig;
+};
+
+template <typename IntType>
+std::istream &operator>>(std::istream &,BasicFraction<IntType> &);
+template <typename IntType>
+std::ostream &operator<<(std::ostream &,const BasicFraction<IntType> &);
+
+// from_chars/to_chars for fractions: "n/d", or just "n" for n/1, on a raw
+// buffer with no streams, locales or allocation (BigInt aside). parsing
+// stops at the first character that doesn't belong, so "(3/4,1/2)" can be
+// read by stepping over the punctuation. the result is reduced; a zero
+// denominator is invalid_argument and a value that doesn't fit is
+// result_out_of_range, leaving f unchanged either way. formatting writes
+// "n/d" with no terminator
+template <typename IntType>
+std::from_chars_result fractionFromChars(const char *first,const char *last,BasicFraction<IntType> &f);
+template <typename IntType>
+std::to_chars_result fractionToChars(char *first,char *last,const BasicFraction<IntType> &f);
 
-std::istream &operator>>(std::istream &,Fraction &);
-std::ostream &operator<<(std::ostream &,Fraction);
+std::istream &operator>>(std::istream &,ExactFraction &);
+std::ostream &operator<<(std::ostream &,const ExactFraction &);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,78 @@
+#include <cstdint>
+
+#ifndef _FRACTIONARRAY_H
+#define _FRACTIONARRAY_H
+
+#include <stdexcept>
+#include <vector>
+#include "fraction.h"
+
+const uint32_t
+    FRACTION_BLOCK = 256;               // elements per pass; the 64-bit
+                                        // temporaries stay in L1
+
+// many Fractions stored as separate numerator and denominator arrays, with
+// element-wise operations that work a block at a time: all the cross
+// products of a block are formed in one pass (four per instruction with
+// AVX2), then the block is reduced with binary gcds run side by side, rather
+// than calling Fraction::operator+ and its gcd one element at a time.
+// results are exact; an element whose reduced value doesn't fit in int32_t
+// throws overflow_error, leaving the elements before it already stored
+class FractionArray {
+public:
+    explicit FractionArray(uint32_t n=0) : nums(n,0),dens(n,1) { }
+    ~FractionArray() = default;
+
+    uint32_t size() const { return (uint32_t)nums.size(); }
+
+    void resize(uint32_t n) {
+        nums.resize(n,0);
+        dens.resize(n,1);
+    }
+
+    void clear() {
+        nums.clear();
+        dens.clear();
+    }
+
+    void push_back(const Fraction &f) {
+        nums.push_back(f.getNum());
+        dens.push_back(f.getDen());
+    }
+
+    Fraction get(uint32_t i) const { return Fraction(nums[i],dens[i]); }
+
+    void set(uint32_t i,const Fraction &f) {
+        nums[i] = f.getNum();
+        dens[i] = f.getDen();
+    }
+
+    // direct access for filling the arrays in bulk; call reduce() afterward
+    // unless every element is already in lowest terms with den > 0
+    int32_t *numData() { return nums.data(); }
+    int32_t *denData() { return dens.data(); }
+    const int32_t *numData() const { return nums.data(); }
+    const int32_t *denData() const { return dens.data(); }
+
+    // out[i] = a[i] op b[i]. a and b must be the same size; out is resized
+    // to match and may be a or b
+    static void add(const FractionArray &a,const FractionArray &b,FractionArray &out);
+    static void sub(const FractionArray &a,const FractionArray &b,FractionArray &out);
+    static void mul(const FractionArray &a,const FractionArray &b,FractionArray &out);
+
+    // out[i] is -1, 0 or 1 as a[i] is less than, equal to or greater than b[i]
+    static void compare(const FractionArray &a,const FractionArray &b,int8_t *out);
+
+    // put every element in lowest terms with a positive denominator; throws
+    // domain_error on a zero denominator
+    void reduce();
+
+private:
+    std::vector<int32_t>
+        nums,
+        dens;
+
+    static void prvCheckSizes(const FractionArray &a,const FractionArray &b,FractionArray *out);
+};
+
+#endif
@@ -0,0 +1,349 @@
+//
+// Unordered dictionary using open addressing with Robin Hood hashing
+//
+// Offers the same search / operator[] / remove / map / size / clear interface
+// as RedBlackTree, so code that never needs keys in order can switch between
+// the two by changing a type.
+//
+
+#ifndef HASHDICTIONARY_H
+#define HASHDICTIONARY_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+static const uint32_t
+    HASHDICT_INIT_CAPACITY = 16,       // always a power of two
+    HASHDICT_MAX_LOAD_NUM = 7,         // grow once more than 7/8 full
+    HASHDICT_MAX_LOAD_DEN = 8,
+    HASHDICT_MAX_DIST = 255,           // probe distances must fit in a byte
+    HASHDICT_SPARSE_DEN = 64;          // never grow a table under 1/64 full to shorten probes
+
+#define REPI(ctr,start,limit) for (uint32_t ctr=(start);(ctr)<(limit);ctr++)
+
+// keys live in the slot their hash picks or a few slots after it. each slot
+// records how far its key is from home (plus one, so 0 marks an empty slot).
+// an insert takes the first slot whose key is closer to home than the new key
+// would be, moving that key and the rest of its run one slot along, so keys
+// that are far from home never get pushed further by ones that are near
+// theirs and probe lengths stay short and even. a search can stop as soon as
+// it sees a key closer to home than it would be, and a remove shifts the
+// following keys back instead of leaving a tombstone.
+//
+// keys and values are moved around as runs shift, so their moves must not
+// throw; an insert that throws (building the key or value, or growing) then
+// leaves the table as it was
+template <typename KeyType,typename ValueType,typename Hash=std::hash<KeyType>,
+          typename Equal=std::equal_to<KeyType>>
+class HashDictionary {
+    static_assert(std::is_nothrow_move_constructible<KeyType>::value &&
+                  std::is_nothrow_move_assignable<KeyType>::value &&
+                  std::is_nothrow_move_constructible<ValueType>::value &&
+                  std::is_nothrow_move_assignable<ValueType>::value,
+                  "HashDictionary needs keys and values whose moves don't throw");
+
+public:
+    explicit HashDictionary(uint32_t _cap=HASHDICT_INIT_CAPACITY,const Hash &_hash=Hash(),
+                            const Equal &_eq=Equal()) :
+        count(0),hash(_hash),eq(_eq) {
+        uint32_t
+            cap = HASHDICT_INIT_CAPACITY;
+
+        while (cap < _cap)
+            cap *= 2;
+
+        prvAllocate(cap);
+    }
+
+    ~HashDictionary() {
+
+        clear();
+        prvDeallocate();
+    }
+
+    HashDictionary(const HashDictionary &) = delete;
+    HashDictionary &operator=(const HashDictionary &) = delete;
+
+    void clear() {
+
+        REPI(i,0,capacity)
+            if (dist[i] != 0) {
+                prvDestroy(i);
+                dist[i] = 0;
+            }
+
+        count = 0;
+    }
+
+    uint32_t size() { return count; }
+
+    bool isEmpty() { return count == 0; }
+
+    ValueType &search(const KeyType &k) {
+        uint32_t
+            pos = prvFind(k);
+
+        if (pos == capacity)
+            throw std::domain_error("Search: Key not found");
+
+        return values[pos];
+    }
+
+    ValueType &operator[](const KeyType &k) {
+        uint32_t
+            pos = prvFind(k);
+
+        // insert may grow the table, so values is read after it
+        if (pos == capacity)
+            pos = prvInsert(KeyType(k));
+
+        return values[pos];
+    }
+
+    ValueType &operator[](KeyType &&k) {
+        uint32_t
+            pos = prvFind(k);
+
+        if (pos == capacity)
+            pos = prvInsert(std::move(k));
+
+        return values[pos];
+    }
+
+    void map(void (*fp)(const KeyType &,ValueType &)) {
+
+        REPI(i,0,capacity)
+            if (dist[i] != 0)
+                (*fp)(keys[i],values[i]);
+    }
+
+    void remove(const KeyType &k) {
+        uint32_t
+            pos = prvFind(k),
+            next;
+
+        if (pos == capacity)
+            throw std::domain_error("Remove: Key not found");
+
+        prvDestroy(pos);
+
+        // backward shift: pull each following displaced key one slot closer
+        // to home, until an empty slot or a key already at home
+        for (next=(pos+1)&mask;dist[next]>1;next=(next+1)&mask) {
+            prvMoveSlot(next,pos,dist[next]-1);
+            pos = next;
+        }
+
+        dist[pos] = 0;
+        count--;
+    }
+
+    // longest probe any key needs; useful for judging the hash function
+    uint32_t maxProbeLength() {
+        uint32_t
+            longest = 0;
+
+        REPI(i,0,capacity)
+            if (dist[i] > longest)
+                longest = dist[i];
+
+        return longest;
+    }
+
+private:
+    KeyType
+        *keys;
+    ValueType
+        *values;
+    uint8_t
+        *dist;
+    uint32_t
+        capacity,
+        mask,
+        count;
+    Hash
+        hash;
+    Equal
+        eq;
+
+    // spread the hash over all bits; std::hash is the identity for integers,
+    // which would put runs of keys in runs of slots
+    uint32_t prvHome(const KeyType &k) {
+        uint64_t
+            h = static_cast<uint64_t>(hash(k)) * 0x9e3779b97f4a7c15ull;
+
+        return static_cast<uint32_t>(h >> 32) & mask;
+    }
+
+    // slot holding k, or capacity if k isn't present
+    uint32_t prvFind(const KeyType &k) {
+        uint32_t
+            pos = prvHome(k),
+            d = 1;
+
+        for (;d<=dist[pos];pos=(pos+1)&mask,d++)
+            if (dist[pos] == d && eq(keys[pos],k))
+                return pos;
+
+        return capacity;
+    }
+
+    // k must not be present; returns the slot it ends up in. the value is
+    // built and the table grown before anything moves
+    uint32_t prvInsert(KeyType &&k) {
+        ValueType
+            v = ValueType();
+        uint32_t
+            pos;
+
+        if ((uint64_t)(count + 1) * HASHDICT_MAX_LOAD_DEN > (uint64_t)capacity * HASHDICT_MAX_LOAD_NUM)
+            prvGrow();
+
+        // growing only helps keys whose homes differ in more bits. if keys
+        // still collide this much in a table this empty, too many of them
+        // share a hash
+        while ((pos = prvPlace(k,v)) == capacity) {
+            if ((uint64_t)count * HASHDICT_SPARSE_DEN < capacity)
+                throw std::overflow_error("HashDictionary: too many keys with the same hash");
+            prvGrow();
+        }
+
+        return pos;
+    }
+
+    // put k and v in the slot Robin Hood picks, moving them out of k and v.
+    // returns the slot, or capacity (with nothing moved) if some key would
+    // end up more than HASHDICT_MAX_DIST-1 steps from home
+    uint32_t prvPlace(KeyType &k,ValueType &v) {
+        uint32_t
+            pos = prvHome(k),
+            d = 1,
+            end;
+
+        // k goes in the first slot holding a key closer to home than k
+        // would be there
+        for (;dist[pos]>=d;pos=(pos+1)&mask)
+            d++;
+
+        if (d > HASHDICT_MAX_DIST)
+            return capacity;
+
+        // the keys from there up to the next empty slot each move one slot
+        // along
+        for (end=pos;dist[end]!=0;end=(end+1)&mask)
+            if (dist[end] + 1u > HASHDICT_MAX_DIST)
+                return capacity;
+
+        if (end != pos) {
+            uint32_t
+                last = (end-1)&mask;
+
+            new (keys + end) KeyType(std::move(keys[last]));
+            new (values + end) ValueType(std::move(values[last]));
+            dist[end] = dist[last] + 1;
+
+            for (end=last;end!=pos;end=(end-1)&mask) {
+                last = (end-1)&mask;
+                keys[end] = std::move(keys[last]);
+                values[end] = std::move(values[last]);
+                dist[end] = dist[last] + 1;
+            }
+
+            keys[pos] = std::move(k);
+            values[pos] = std::move(v);
+        } else {
+            new (keys + pos) KeyType(std::move(k));
+            new (values + pos) ValueType(std::move(v));
+        }
+
+        dist[pos] = d;
+        count++;
+
+        return pos;
+    }
+
+    // move the key and value in slot from to the empty slot to, which is d-1
+    // steps from home. slot from is left empty
+    void prvMoveSlot(uint32_t from,uint32_t to,uint32_t d) {
+
+        new (keys + to) KeyType(std::move(keys[from]));
+        new (values + to) ValueType(std::move(values[from]));
+        dist[to] = d;
+        prvDestroy(from);
+        dist[from] = 0;
+    }
+
+    void prvDestroy(uint32_t pos) {
+
+        keys[pos].~KeyType();
+        values[pos].~ValueType();
+    }
+
+    // if an allocation throws, the table keeps its old arrays
+    void prvAllocate(uint32_t cap) {
+        auto
+            newKeys = std::allocator<KeyType>().allocate(cap);
+        ValueType
+            *newValues = nullptr;
+
+        try {
+            newValues = std::allocator<ValueType>().allocate(cap);
+            dist = new uint8_t[cap]();
+        } catch (...) {
+            if (newValues != nullptr)
+                std::allocator<ValueType>().deallocate(newValues,cap);
+            std::allocator<KeyType>().deallocate(newKeys,cap);
+            throw;
+        }
+
+        keys = newKeys;
+        values = newValues;
+        capacity = cap;
+        mask = cap - 1;
+    }
+
+    void prvDeallocate() {
+
+        std::allocator<KeyType>().deallocate(keys,capacity);
+        std::allocator<ValueType>().deallocate(values,capacity);
+        delete[] dist;
+    }
+
+    // double the table and reinsert every key. a probe is never longer in the
+    // doubled table (keys that shared a home either still do or have split
+    // up), so no key can fail to fit
+    void prvGrow() {
+        KeyType
+            *oldKeys = keys;
+        ValueType
+            *oldValues = values;
+        uint8_t
+            *oldDist = dist;
+        uint32_t
+            oldCap = capacity;
+
+        if (capacity >= 0x80000000u)
+            throw std::overflow_error("HashDictionary: table is full");
+
+        prvAllocate(capacity * 2);
+        count = 0;
+
+        REPI(i,0,oldCap)
+            if (oldDist[i] != 0) {
+                prvPlace(oldKeys[i],oldValues[i]);
+                oldKeys[i].~KeyType();
+                oldValues[i].~ValueType();
+            }
+
+        std::allocator<KeyType>().deallocate(oldKeys,oldCap);
+        std::allocator<ValueType>().deallocate(oldValues,oldCap);
+        delete[] oldDist;
+    }
+};
+
+#endif
@@ -11,65 +11,570 @@
 #include <cstdint>
 #include <stdexcept>
 #include <cmath>
-
-#define GET_COUNT(n) (((n) == NULL_INDEX) ? 0 : counts[n])
-#define GET_HEIGHT(n) (((n) == NULL_INDEX) ? 0 : heights[n])
-#define IS_RED(n) (((n) == NULL_INDEX) ? false : (colors[n] == NODE_RED))
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include <string>
+#include <string_view>
+// mapFile() needs POSIX mmap; save() and load() work everywhere
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define GET_COUNT(n) (((n) == NULL_INDEX) ? 0 : counts(n))
+#define GET_HEIGHT(n) (((n) == NULL_INDEX) ? 0 : heights(n))
+#define IS_RED(n) (((n) == NULL_INDEX) ? false : (colors(n) == NODE_RED))
 #define REPI(ctr,start,limit) for (uint32_t ctr=(start);(ctr)<(limit);ctr++)
 
 static const uint32_t
     NODE_BLACK = 0,
     NODE_RED = 1,
     NULL_INDEX = 0xffffffff,
-    DEFAULT_INIT_CAPACITY = 16;
+    DEFAULT_INIT_CAPACITY = 16,
+    BATCH_PARALLEL_CUTOFF = 16384,     // don't spawn threads for less work than this
+    SEARCH_BATCH_LANES = 16,           // descents interleaved by searchBatch
+    RBTREE_FILE_VERSION = 1,
+    RBTREE_FILE_ALIGN = 64;            // arrays in a saved tree start on this boundary
+
+// saved trees start with this header, followed by the storage's arrays, each
+// holding count elements. the format is native-endian and only for keys and
+// values that are trivially copyable
+struct RedBlackTreeFileHeader {
+    char
+        magic[8];
+    uint32_t
+        version,
+        layout,
+        keySize,
+        valueSize,
+        count,
+        root;
+};
+
+static const char
+    RBTREE_FILE_MAGIC[8] = {'R','B','T','R','E','E','\r','\n'};
+
+// three-way key comparison: negative, zero or positive as a is less than,
+// equal to or greater than b
+template <typename KeyType,typename=void>
+struct RedBlackTreeCompare {
+    int operator()(const KeyType &a,const KeyType &b) const {
+        return (a < b) ? -1 : ((b < a) ? 1 : 0);
+    }
+};
+
+// keys with their own three-way compare(), like Fraction and BigInt, answer
+// in one call instead of two operator<s
+template <typename KeyType>
+struct RedBlackTreeCompare<KeyType,
+                           std::void_t<decltype(std::declval<const KeyType &>().compare(
+                               std::declval<const KeyType &>()))>> {
+    int operator()(const KeyType &a,const KeyType &b) const {
+        return a.compare(b);
+    }
+};
+
+// strings compare once per level, and is_transparent lets search() take a
+// string_view or const char * without building a temporary std::string
+template <>
+struct RedBlackTreeCompare<std::string> {
+    using is_transparent = void;
+
+    int operator()(std::string_view a,std::string_view b) const {
+        return a.compare(b);
+    }
+};
+
+// storage classes only hand out memory for keys and values; the tree
+// constructs them in place when a node is allocated and destroys them when it
+// is freed, and growth moves them into the larger space
+
+// node layouts. SplitLayout keeps one array per node field. PackedLayout
+// keeps what a descent touches, {key,left,right,color}, together in one hot
+// record, and values, counts and heights in a cold side array, so each level
+// of a search costs one cache miss instead of three
+struct SplitLayout {};
+struct PackedLayout {};
+
+// copy a trivially copyable object a word (or, if it isn't word-sized and
+// aligned, a byte) at a time with relaxed atomics. optimistic readers use
+// these for keys and values that a writer may be changing; the writer's
+// stores and the readers' loads then use the same pieces
+template <typename T>
+using RelaxedPiece = std::conditional_t<alignof(T) >= alignof(uint32_t) && sizeof(T) % sizeof(uint32_t) == 0,
+                                        uint32_t,unsigned char>;
+
+template <typename T>
+void relaxedLoad(T &dst,const T *src) {
+    auto
+        d = reinterpret_cast<RelaxedPiece<T> *>(&dst);
+    auto
+        p = reinterpret_cast<const RelaxedPiece<T> *>(src);
+
+    REPI(i,0,sizeof(T)/sizeof(*p))
+        d[i] = __atomic_load_n(p + i,__ATOMIC_RELAXED);
+}
+
+template <typename T>
+void relaxedStore(T *dst,const T &src) {
+    auto
+        d = reinterpret_cast<RelaxedPiece<T> *>(dst);
+    auto
+        p = reinterpret_cast<const RelaxedPiece<T> *>(&src);
+
+    REPI(i,0,sizeof(T)/sizeof(*p))
+        __atomic_store_n(d + i,p[i],__ATOMIC_RELAXED);
+}
+
+template <typename KeyType,typename ValueType,typename Layout>
+class RedBlackTreeStorage;
 
 template <typename KeyType,typename ValueType>
-class RedBlackTree {
+class RedBlackTreeStorage<KeyType,ValueType,SplitLayout> {
+public:
+    static const uint32_t
+        LAYOUT_ID = 0;
+
+    // visit each array, in the order they are saved
+    template <typename Fn>
+    void forEachArray(Fn fn) {
+
+        fn(lefts);
+        fn(rights);
+        fn(nodeCounts);
+        fn(nodeHeights);
+        fn(nodeRefs);
+        fn(nodeColors);
+        fn(nodeKeys);
+        fn(nodeValues);
+    }
+
+    void allocate(uint32_t cap) {
+
+        lefts = new uint32_t[cap];
+        rights = new uint32_t[cap];
+        nodeCounts = new uint32_t[cap];
+        nodeHeights = new uint32_t[cap];
+        nodeRefs = new uint32_t[cap];
+
+        nodeColors = new uint8_t[cap];
+
+        nodeKeys = std::allocator<KeyType>().allocate(cap);
+        nodeValues = std::allocator<ValueType>().allocate(cap);
+    }
+
+    void deallocate(uint32_t cap) {
+
+        std::allocator<ValueType>().deallocate(nodeValues,cap);
+        std::allocator<KeyType>().deallocate(nodeKeys,cap);
+        delete[] nodeColors;
+        delete[] nodeRefs;
+        delete[] nodeHeights;
+        delete[] nodeCounts;
+        delete[] rights;
+        delete[] lefts;
+    }
+
+    // move the first n nodes of src here. slots marked in isFree hold no key
+    // or value, only their free list link
+    void relocate(RedBlackTreeStorage &src,uint32_t n,const std::vector<bool> &isFree) {
+
+        REPI(i,0,n) {
+            lefts[i] = src.lefts[i];
+            rights[i] = src.rights[i];
+            nodeCounts[i] = src.nodeCounts[i];
+            nodeHeights[i] = src.nodeHeights[i];
+            nodeRefs[i] = src.nodeRefs[i];
+            nodeColors[i] = src.nodeColors[i];
+
+            if (isFree[i])
+                continue;
+
+            new (nodeKeys + i) KeyType(std::move(src.nodeKeys[i]));
+            new (nodeValues + i) ValueType(std::move(src.nodeValues[i]));
+
+            src.nodeKeys[i].~KeyType();
+            src.nodeValues[i].~ValueType();
+        }
+    }
+
+    uint32_t &left(uint32_t r) { return lefts[r]; }
+    uint32_t &right(uint32_t r) { return rights[r]; }
+    uint32_t &counts(uint32_t r) { return nodeCounts[r]; }
+    uint32_t &heights(uint32_t r) { return nodeHeights[r]; }
+    uint8_t &colors(uint32_t r) { return nodeColors[r]; }
+    KeyType &keys(uint32_t r) { return nodeKeys[r]; }
+    ValueType &values(uint32_t r) { return nodeValues[r]; }
+    uint32_t &refs(uint32_t r) { return nodeRefs[r]; }
+
+    // a descent reads the key and both links of the next node
+    void prefetch(uint32_t r) {
+
+        __builtin_prefetch(nodeKeys + r);
+        __builtin_prefetch(lefts + r);
+        __builtin_prefetch(rights + r);
+    }
+
+    // for optimistic readers, which run while a writer may be changing the
+    // nodes: array pointers and fields are read with atomic loads
+    uint32_t loadLeft(uint32_t r) const { return __atomic_load_n(prvArray(lefts) + r,__ATOMIC_RELAXED); }
+    uint32_t loadRight(uint32_t r) const { return __atomic_load_n(prvArray(rights) + r,__ATOMIC_RELAXED); }
+    uint32_t loadCount(uint32_t r) const { return __atomic_load_n(prvArray(nodeCounts) + r,__ATOMIC_RELAXED); }
+    const KeyType *keyAddress(uint32_t r) const { return prvArray(nodeKeys) + r; }
+    const ValueType *valueAddress(uint32_t r) const { return prvArray(nodeValues) + r; }
+
+    // and the writer's side: every field above is changed with atomic stores
+    void storeLeft(uint32_t r,uint32_t v) { __atomic_store_n(lefts + r,v,__ATOMIC_RELAXED); }
+    void storeRight(uint32_t r,uint32_t v) { __atomic_store_n(rights + r,v,__ATOMIC_RELAXED); }
+    void storeCount(uint32_t r,uint32_t v) { __atomic_store_n(nodeCounts + r,v,__ATOMIC_RELAXED); }
+
+    // switch to src's arrays. each pointer is stored atomically and with
+    // release, so a reader that loads it also sees the nodes src holds
+    void publish(const RedBlackTreeStorage &src) {
+
+        __atomic_store_n(&lefts,src.lefts,__ATOMIC_RELEASE);
+        __atomic_store_n(&rights,src.rights,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeCounts,src.nodeCounts,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeHeights,src.nodeHeights,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeRefs,src.nodeRefs,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeColors,src.nodeColors,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeKeys,src.nodeKeys,__ATOMIC_RELEASE);
+        __atomic_store_n(&nodeValues,src.nodeValues,__ATOMIC_RELEASE);
+    }
+
+private:
+    template <typename T>
+    static T *prvArray(T *const &a) { return __atomic_load_n(&a,__ATOMIC_ACQUIRE); }
+
+    uint32_t
+        *lefts,
+        *rights,
+        *nodeCounts,
+        *nodeHeights,
+        *nodeRefs;
+
+    uint8_t
+        *nodeColors;
+
+    KeyType
+        *nodeKeys;
+
+    ValueType
+        *nodeValues;
+};
+
+template <typename KeyType,typename ValueType>
+class RedBlackTreeStorage<KeyType,ValueType,PackedLayout> {
 public:
-    explicit RedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY) {
+    static const uint32_t
+        LAYOUT_ID = 1;
+
+    template <typename Fn>
+    void forEachArray(Fn fn) {
+
+        fn(hot);
+        fn(cold);
+    }
 
-        if (nTrees == 0) {
-            left = new uint32_t[_cap];
-            right = new uint32_t[_cap];
-            counts = new uint32_t[_cap];
-            heights = new uint32_t[_cap];
+    void allocate(uint32_t cap) {
 
-            colors = new uint8_t[_cap];
+        hot = new HotNode[cap];
+        cold = new ColdNode[cap];
+    }
+
+    void deallocate(uint32_t) {
+
+        delete[] cold;
+        delete[] hot;
+    }
 
-            keys = new KeyType[_cap];
-            values = new ValueType[_cap];
+    void relocate(RedBlackTreeStorage &src,uint32_t n,const std::vector<bool> &isFree) {
 
-            capacity = _cap;
+        REPI(i,0,n) {
+            hot[i].left = src.hot[i].left;
+            hot[i].right = src.hot[i].right;
+            hot[i].color = src.hot[i].color;
+            cold[i].count = src.cold[i].count;
+            cold[i].height = src.cold[i].height;
+            cold[i].refs = src.cold[i].refs;
 
-            REPI(i,0,capacity-1)
-                left[i] = i + 1;
-            left[capacity-1] = NULL_INDEX;
+            if (isFree[i])
+                continue;
 
-            freeListHead = 0;
+            new (&hot[i].key) KeyType(std::move(src.hot[i].key));
+            new (&cold[i].value) ValueType(std::move(src.cold[i].value));
+
+            src.hot[i].key.~KeyType();
+            src.cold[i].value.~ValueType();
         }
+    }
+
+    uint32_t &left(uint32_t r) { return hot[r].left; }
+    uint32_t &right(uint32_t r) { return hot[r].right; }
+    uint32_t &counts(uint32_t r) { return cold[r].count; }
+    uint32_t &heights(uint32_t r) { return cold[r].height; }
+    uint8_t &colors(uint32_t r) { return hot[r].color; }
+    KeyType &keys(uint32_t r) { return hot[r].key; }
+    ValueType &values(uint32_t r) { return cold[r].value; }
+    uint32_t &refs(uint32_t r) { return cold[r].refs; }
+
+    void prefetch(uint32_t r) { __builtin_prefetch(hot + r); }
 
-        nTrees++;
+    // for optimistic readers; see the split layout
+    uint32_t loadLeft(uint32_t r) const { return __atomic_load_n(&prvArray(hot)[r].left,__ATOMIC_RELAXED); }
+    uint32_t loadRight(uint32_t r) const { return __atomic_load_n(&prvArray(hot)[r].right,__ATOMIC_RELAXED); }
+    uint32_t loadCount(uint32_t r) const { return __atomic_load_n(&prvArray(cold)[r].count,__ATOMIC_RELAXED); }
+    const KeyType *keyAddress(uint32_t r) const { return &prvArray(hot)[r].key; }
+    const ValueType *valueAddress(uint32_t r) const { return &prvArray(cold)[r].value; }
 
-        root = NULL_INDEX;
+    void storeLeft(uint32_t r,uint32_t v) { __atomic_store_n(&hot[r].left,v,__ATOMIC_RELAXED); }
+    void storeRight(uint32_t r,uint32_t v) { __atomic_store_n(&hot[r].right,v,__ATOMIC_RELAXED); }
+    void storeCount(uint32_t r,uint32_t v) { __atomic_store_n(&cold[r].count,v,__ATOMIC_RELAXED); }
+
+    void publish(const RedBlackTreeStorage &src) {
+
+        __atomic_store_n(&hot,src.hot,__ATOMIC_RELEASE);
+        __atomic_store_n(&cold,src.cold,__ATOMIC_RELEASE);
     }
 
+private:
+    template <typename T>
+    static T *prvArray(T *const &a) { return __atomic_load_n(&a,__ATOMIC_ACQUIRE); }
+
+    // the unions keep new[] and delete[] from constructing or destroying keys
+    // and values
+    struct HotNode {
+        HotNode() { }
+        ~HotNode() { }
+
+        union {
+            KeyType
+                key;
+        };
+        uint32_t
+            left,
+            right;
+        uint8_t
+            color;
+    };
+
+    struct ColdNode {
+        ColdNode() { }
+        ~ColdNode() { }
+
+        union {
+            ValueType
+                value;
+        };
+        uint32_t
+            count,
+            height,
+            refs;
+    };
+
+    HotNode
+        *hot;
+
+    ColdNode
+        *cold;
+};
+
+// node storage for red-black trees. by default each tree owns a pool, so
+// unrelated trees don't share locality or growth and can live on different
+// threads. trees built on the same pool share its space; such trees must all
+// be used from one thread at a time, and be destroyed before the pool
+template <typename KeyType,typename ValueType,typename Layout=SplitLayout>
+class RedBlackTreePool {
+public:
+    explicit RedBlackTreePool(uint32_t _cap=DEFAULT_INIT_CAPACITY) {
+
+        capacity = (_cap > 0) ? _cap : 1;
+
+        store.allocate(capacity);
+
+        REPI(i,0,capacity-1)
+            store.left(i) = i + 1;
+        store.left(capacity-1) = NULL_INDEX;
+
+        freeListHead = 0;
+        freeCount = capacity;
+    }
+
+    ~RedBlackTreePool() {
+
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapBase != nullptr)
+            munmap(mapBase,mapLength);
+        else
+#endif
+            store.deallocate(capacity);
+
+        for (auto &r : retired)
+            r.first.deallocate(r.second);
+    }
+
+    RedBlackTreePool(const RedBlackTreePool &) = delete;
+    RedBlackTreePool &operator=(const RedBlackTreePool &) = delete;
+
+    uint32_t getCapacity() { return capacity; }
+
+private:
+    template <typename,typename,typename,typename>
+    friend class RedBlackTree;
+
+    template <typename,typename,typename,typename>
+    friend class ConcurrentRedBlackTree;
+
+    // read-only pool over a saved tree mapped into memory
+    RedBlackTreePool(void *_base,size_t _length,uint32_t n) {
+
+        auto
+            p = static_cast<char *>(_base) + sizeof(RedBlackTreeFileHeader);
+
+        store.forEachArray([&](auto *&a) {
+            p += (RBTREE_FILE_ALIGN - (p - static_cast<char *>(_base)) % RBTREE_FILE_ALIGN) % RBTREE_FILE_ALIGN;
+            a = reinterpret_cast<std::remove_reference_t<decltype(a)>>(p);
+            p += (size_t)n * sizeof(*a);
+        });
+
+        capacity = n;
+        freeListHead = NULL_INDEX;
+        freeCount = 0;
+
+        mapBase = _base;
+        mapLength = _length;
+    }
+
+    // grow now, if need be, so the next n allocate() calls can't have to (or
+    // fail). growing doesn't change what any index holds, so optimistic
+    // readers can run while it does
+    void reserve(uint32_t n=1) {
+
+        while (freeCount < n) {
+            RedBlackTreeStorage<KeyType,ValueType,Layout>
+                tmp;
+            std::vector<bool>
+                isFree(capacity,false);
+
+            for (uint32_t r=freeListHead;r!=NULL_INDEX;r=store.left(r))
+                isFree[r] = true;
+
+            tmp.allocate(2*capacity);
+            tmp.relocate(store,capacity,isFree);
+
+            // the new slots go in front of any that were still free
+            REPI(i,capacity,2*capacity-1)
+                tmp.left(i) = i + 1;
+            tmp.left(2*capacity-1) = freeListHead;
+
+            // optimistic readers may still be looking at the old space, so
+            // it is kept until the pool goes away
+            if (keepRetired)
+                retired.emplace_back(store,capacity);
+            else
+                store.deallocate(capacity);
+
+            // publish the new space before the new capacity, so a reader
+            // that sees the larger capacity also sees the larger space
+            store.publish(tmp);
+
+            freeListHead = capacity;
+            freeCount += capacity;
+
+            __atomic_store_n(&capacity,2 * capacity,__ATOMIC_RELEASE);
+        }
+    }
+
+    uint32_t allocate() {
+
+        reserve();
+
+        uint32_t
+            tmp = freeListHead;
+
+        freeListHead = store.left(freeListHead);
+        freeCount--;
+
+        return tmp;
+    }
+
+    void release(uint32_t r) {
+
+        store.storeLeft(r,freeListHead);
+        freeListHead = r;
+        freeCount++;
+    }
+
+    RedBlackTreeStorage<KeyType,ValueType,Layout>
+        store;
+
+    uint32_t
+        freeListHead,
+        freeCount,
+        capacity;
+
+    bool
+        keepRetired = false;
+
+    void
+        *mapBase = nullptr;
+
+    size_t
+        mapLength = 0;
+
+    std::vector<std::pair<RedBlackTreeStorage<KeyType,ValueType,Layout>,uint32_t>>
+        retired;
+};
+
+template <typename KeyType,typename ValueType,typename Compare=RedBlackTreeCompare<KeyType>,
+          typename Layout=SplitLayout>
+class RedBlackTree {
+public:
+    using Pool = RedBlackTreePool<KeyType,ValueType,Layout>;
+
+    // the tree gets a pool of its own
+    explicit RedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY,const Compare &_cmp=Compare()) :
+        pool(new Pool(_cap)),ownsPool(true),root(NULL_INDEX),cmp(_cmp) { }
+
+    // the tree takes its nodes from an existing pool; the pool must outlive it
+    explicit RedBlackTree(Pool &arena,const Compare &_cmp=Compare()) :
+        pool(&arena),ownsPool(false),root(NULL_INDEX),cmp(_cmp) { }
+
     ~RedBlackTree() {
 
-        nTrees--;
+        if (!isReadOnly())
+            prvRelease(root);
 
-        if (nTrees == 0) {
-            delete[] values;
-            delete[] keys;
-            delete[] colors;
-            delete[] heights;
-            delete[] counts;
-            delete[] right;
-            delete[] left;
-        } else
-            prvClear(root);
+        if (ownsPool)
+            delete pool;
+    }
+
+    RedBlackTree(const RedBlackTree &) = delete;
+    RedBlackTree &operator=(const RedBlackTree &) = delete;
+
+    void clear() {
+
+        // dropping a mapped file leaves an ordinary empty tree
+        if (isReadOnly())
+            prvReplacePool(new Pool(),NULL_INDEX);
+        else
+            prvRelease(root);
+
+        prvSetRoot(NULL_INDEX);
     }
 
-    void clear() { prvClear(root); root = NULL_INDEX; }
+    // trees loaded with mapFile() can't be changed
+    bool isReadOnly() { return pool->mapBase != nullptr; }
 
     uint32_t size() { return GET_COUNT(root); }
 
@@ -79,187 +584,1018 @@ public:
 
     ValueType &search(const KeyType &k) {
 
-        for (uint32_t r=root;r!=NULL_INDEX;) {
-            if (k == keys[r])
-                return values[r];
-            if (k < keys[r])
-                r = left[r];
-            else
-                r = right[r];
-        }
+        return values(prvFind(root,k));
+    }
 
-        throw std::domain_error("Search: Key not found");
+    // heterogeneous lookup, only if the comparator is transparent
+    template <typename QueryType,typename C=Compare,typename=typename C::is_transparent>
+    ValueType &search(const QueryType &k) {
+
+        return values(prvFind(root,k));
     }
 
     ValueType &operator[](const KeyType &k) {
+        uint32_t
+            node;
+        bool
+            inserted;
 
-        root = prvInsert(root,k);
+        prvCheckWritable();
+        prvReserveInsert();
 
-        colors[root] = NODE_BLACK;
+        prvSetRoot(prvInsert(root,k,node,inserted));
 
-        for (uint32_t r=root;r!=NULL_INDEX;) {
-            if (k == keys[r])
-                return values[r];
-            if (k < keys[r])
-                r = left[r];
-            else
-                r = right[r];
+        colors(root) = NODE_BLACK;
+
+        return values(node);
+    }
+
+    ValueType &operator[](KeyType &&k) {
+        uint32_t
+            node;
+        bool
+            inserted;
+
+        prvCheckWritable();
+        prvReserveInsert();
+
+        prvSetRoot(prvInsert(root,std::move(k),node,inserted));
+
+        colors(root) = NODE_BLACK;
+
+        return values(node);
+    }
+
+    // set k's value to one built from args, inserting k if needed
+    template <typename K,typename... Args>
+    ValueType &emplace(K &&k,Args &&...args) {
+        uint32_t
+            node;
+        bool
+            inserted;
+
+        prvCheckWritable();
+        prvReserveInsert();
+
+        prvSetRoot(prvInsert(root,std::forward<K>(k),node,inserted,std::forward<Args>(args)...));
+
+        colors(root) = NODE_BLACK;
+
+        if (!inserted)
+            prvAssign(values(node),ValueType(std::forward<Args>(args)...));
+
+        return values(node);
+    }
+
+    // insert k with a value built from args; if k is already present, nothing
+    // is built or changed. returns true if k was inserted
+    template <typename K,typename... Args>
+    bool tryEmplace(K &&k,Args &&...args) {
+        uint32_t
+            node;
+        bool
+            inserted;
+
+        prvCheckWritable();
+        prvReserveInsert();
+
+        prvSetRoot(prvInsert(root,std::forward<K>(k),node,inserted,std::forward<Args>(args)...));
+
+        colors(root) = NODE_BLACK;
+
+        return inserted;
+    }
+
+    // insert n key/value pairs at once; if a key repeats, the last value wins.
+    // large batches are sorted, merged with the existing nodes and the tree is
+    // rebuilt bottom-up, with both the sort and the build split across threads
+    void insertBatch(const KeyType *batchKeys,const ValueType *batchValues,uint32_t n) {
+        uint32_t
+            nOld = GET_COUNT(root),
+            nNew = 0,
+            nTotal = 0,
+            depth = 0;
+
+        prvCheckWritable();
+
+        if (n == 0)
+            return;
+
+        // a few keys into a big tree are cheaper to insert one at a time
+        if ((uint64_t)n * (GET_HEIGHT(root) + 1) < nOld) {
+            REPI(i,0,n)
+                (*this)[batchKeys[i]] = batchValues[i];
+            return;
         }
 
-        throw std::domain_error("Search: Key not found");
+        for (uint32_t t=std::thread::hardware_concurrency();t>1;t=(t+1)/2)
+            depth++;
+
+        // sort batch positions by key; stable, so equal keys stay in batch order
+        auto
+            idx = new uint32_t[n];
+
+        REPI(i,0,n)
+            idx[i] = i;
+
+        prvSortBatch(idx,n,batchKeys,depth,cmp);
+
+        // keep only the last occurrence of each key
+        REPI(i,0,n)
+            if (i + 1 == n || cmp(batchKeys[idx[i]],batchKeys[idx[i+1]]) < 0)
+                idx[nNew++] = idx[i];
+
+        // merge existing nodes (in order) with the batch; existing nodes are
+        // reused, new keys get fresh nodes
+        auto
+            oldNodes = new uint32_t[nOld+1];
+        auto
+            order = new uint32_t[nOld+nNew];
+        uint32_t
+            nOldSeen = 0,
+            i = 0,
+            j = 0;
+
+        prvGather(root,true,oldNodes,nOldSeen);
+
+        while (i < nOld || j < nNew) {
+            int
+                c = (j == nNew) ? -1 : ((i == nOld) ? 1 : cmp(keys(oldNodes[i]),batchKeys[idx[j]]));
+
+            if (c < 0)
+                order[nTotal++] = oldNodes[i++];
+            else if (c == 0) {
+                prvAssign(values(oldNodes[i]),batchValues[idx[j++]]);
+                order[nTotal++] = oldNodes[i++];
+            } else {
+                uint32_t
+                    tmp = prvAllocate();
+
+                prvConstruct(keys(tmp),batchKeys[idx[j]]);
+                prvConstruct(values(tmp),batchValues[idx[j++]]);
+
+                order[nTotal++] = tmp;
+            }
+        }
+
+        // smallest black height that can hold all of the nodes
+        uint32_t
+            bh = 0;
+
+        for (uint64_t p=1;p-1<nTotal;p*=3)
+            bh++;
+
+        prvSetRoot(prvBuild(order,nTotal,bh,depth));
+
+        delete[] order;
+        delete[] oldNodes;
+        delete[] idx;
+    }
+
+    // look up n keys at once; out[i] points to the value for batchKeys[i], or
+    // is nullptr if that key isn't in the tree. several descents are walked in
+    // turn, each prefetching its next node, so their cache misses overlap
+    // instead of being paid one after another
+    void searchBatch(const KeyType *batchKeys,uint32_t n,ValueType **out) {
+        uint32_t
+            nodes[SEARCH_BATCH_LANES],
+            queries[SEARCH_BATCH_LANES],
+            nLanes = 0,
+            next = 0;
+
+        // start one descent per lane
+        while (nLanes < SEARCH_BATCH_LANES && next < n) {
+            nodes[nLanes] = root;
+            queries[nLanes++] = next++;
+        }
+
+        while (nLanes > 0)
+            for (uint32_t l=0;l<nLanes;) {
+                uint32_t
+                    r = nodes[l];
+                int
+                    c = (r == NULL_INDEX) ? 0 : cmp(batchKeys[queries[l]],keys(r));
+
+                if (c != 0) {
+                    nodes[l] = (c < 0) ? left(r) : right(r);
+                    if (nodes[l] != NULL_INDEX)
+                        pool->store.prefetch(nodes[l]);
+                    l++;
+                    continue;
+                }
+
+                out[queries[l]] = (r == NULL_INDEX) ? nullptr : &values(r);
+
+                // this descent is done; start the next key in its lane, or
+                // retire the lane if there are no more keys
+                if (next < n) {
+                    nodes[l] = root;
+                    queries[l++] = next++;
+                } else {
+                    nLanes--;
+                    nodes[l] = nodes[nLanes];
+                    queries[l] = queries[nLanes];
+                }
+            }
     }
 
     void map(void (*fp)(const KeyType &,ValueType &)) {
 
-        prvMap(root,fp);
+        prvCheckWritable();
+
+        prvSetRoot(prvMap(root,fp));
     }
 
     void remove(const KeyType &k) {
         uint32_t
             ntbd;
 
+        prvCheckWritable();
+
         try {
             search(k);
         } catch (const std::domain_error &e) {
             throw std::domain_error("Remove: Key not found");
         }
 
-        if (!IS_RED(left[root]) && !IS_RED(right[root]))
-            colors[root] = NODE_RED;
+        prvSetRoot(prvMut(root));
+
+        if (!IS_RED(left(root)) && !IS_RED(right(root)))
+            colors(root) = NODE_RED;
 
-        root = prvRemove(root,ntbd,k);
+        prvSetRoot(prvRemove(root,ntbd,k));
 
-        prvFree(ntbd);
+        prvRelease(ntbd);
 
         if (root != NULL_INDEX)
-            colors[root] = NODE_BLACK;
+            colors(root) = NODE_BLACK;
     }
 
-    void isValidRBTree() {
+    // read-only view of the tree as it was when snapshot() was called.
+    // snapshots share nodes with the tree; a node that a snapshot can still
+    // see is copied before the tree changes it, so taking a snapshot is O(1)
+    // and each later update copies O(log n) nodes. nodes are reference
+    // counted and go back to the pool when neither the tree nor any snapshot
+    // can reach them. a snapshot must not outlive its tree, and it isn't safe
+    // to read one on another thread while the tree is being updated
+    class Snapshot {
+    public:
+        Snapshot(const Snapshot &other) : tree(other.tree),root(other.root) {
+
+            if (root != NULL_INDEX)
+                tree->refs(root)++;
+            tree->liveSnapshots++;
+        }
+
+        ~Snapshot() {
+
+            tree->prvRelease(root);
+            tree->liveSnapshots--;
+        }
+
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        uint32_t size() { return (root == NULL_INDEX) ? 0 : tree->counts(root); }
+
+        bool isEmpty() { return root == NULL_INDEX; }
+
+        const ValueType &search(const KeyType &k) {
+
+            return tree->values(tree->prvFind(root,k));
+        }
+
+        template <typename QueryType,typename C=Compare,typename=typename C::is_transparent>
+        const ValueType &search(const QueryType &k) {
+
+            return tree->values(tree->prvFind(root,k));
+        }
+
+        void map(void (*fp)(const KeyType &,const ValueType &)) {
+
+            tree->prvVisit(root,fp);
+        }
+
+    private:
+        friend class RedBlackTree;
+
+        Snapshot(RedBlackTree *_tree,uint32_t _root) : tree(_tree),root(_root) {
+
+            if (root != NULL_INDEX)
+                tree->refs(root)++;
+            tree->liveSnapshots++;
+        }
+
+        RedBlackTree
+            *tree;
+
         uint32_t
-            leafDepth = NULL_INDEX;
+            root;
+    };
 
-        if (root == NULL_INDEX)
-            return;
+    // note: values reached through search() or searchBatch() may be shared
+    // with snapshots; update them through operator[] or emplace(). on a tree
+    // loaded with mapFile(), inserts, removes, map() and snapshot() throw
+    // logic_error, but a value written through search() or searchBatch() is
+    // changed in memory only and never reaches the file
+    Snapshot snapshot() {
 
-        prvIsValid(root,leafDepth,0);
+        prvCheckWritable();
 
-        if (GET_HEIGHT(root) > 2 * ceil(log2(GET_COUNT(root)+1)))
-            throw std::logic_error("tree too tall");
+        return Snapshot(this,root);
     }
 
-private:
-    uint32_t prvAllocate() {
+    // write the tree to a file. nodes are renumbered in breadth-first order,
+    // so the file holds exactly size() nodes and the top of the tree is
+    // packed together at the front of each array
+    void save(const std::string &fileName) {
+        static_assert(std::is_trivially_copyable<KeyType>::value &&
+                      std::is_trivially_copyable<ValueType>::value,
+                      "only trees of trivially copyable keys and values can be saved");
+        RedBlackTreeStorage<KeyType,ValueType,Layout>
+            tmp;
+        RedBlackTreeFileHeader
+            header;
+        uint32_t
+            n = GET_COUNT(root),
+            head = 0,
+            tail = 0;
+        auto
+            order = new uint32_t[n+1];
+
+        tmp.allocate(n+1);
+
+        if (root != NULL_INDEX)
+            order[tail++] = root;
+
+        // a node's new index is its position in the queue
+        while (head < tail) {
+            uint32_t
+                r = order[head];
+
+            tmp.left(head) = (left(r) == NULL_INDEX) ? NULL_INDEX : tail;
+            if (left(r) != NULL_INDEX)
+                order[tail++] = left(r);
+            tmp.right(head) = (right(r) == NULL_INDEX) ? NULL_INDEX : tail;
+            if (right(r) != NULL_INDEX)
+                order[tail++] = right(r);
+
+            tmp.counts(head) = counts(r);
+            tmp.heights(head) = heights(r);
+            tmp.colors(head) = colors(r);
+            tmp.refs(head) = 1;
+            new (&tmp.keys(head)) KeyType(keys(r));
+            new (&tmp.values(head)) ValueType(values(r));
+
+            head++;
+        }
+
+        memset(&header,0,sizeof(header));
+        memcpy(header.magic,RBTREE_FILE_MAGIC,sizeof(header.magic));
+        header.version = RBTREE_FILE_VERSION;
+        header.layout = RedBlackTreeStorage<KeyType,ValueType,Layout>::LAYOUT_ID;
+        header.keySize = sizeof(KeyType);
+        header.valueSize = sizeof(ValueType);
+        header.count = n;
+        header.root = (n == 0) ? NULL_INDEX : 0;
+
+        std::ofstream
+            out(fileName,std::ios::binary);
+        size_t
+            pos = sizeof(header);
+        const char
+            padding[RBTREE_FILE_ALIGN] = {};
+
+        out.write(reinterpret_cast<const char *>(&header),sizeof(header));
+
+        tmp.forEachArray([&](auto *a) {
+            size_t
+                pad = (RBTREE_FILE_ALIGN - pos % RBTREE_FILE_ALIGN) % RBTREE_FILE_ALIGN;
+
+            out.write(padding,pad);
+            out.write(reinterpret_cast<const char *>(a),(size_t)n * sizeof(*a));
+            pos += pad + (size_t)n * sizeof(*a);
+        });
+
+        tmp.deallocate(n+1);
+        delete[] order;
+
+        if (!out)
+            throw std::runtime_error("RedBlackTree: can't write " + fileName);
+    }
+
+    // replace the tree with one saved by save(); the tree stays changeable
+    void load(const std::string &fileName) {
+        static_assert(std::is_trivially_copyable<KeyType>::value &&
+                      std::is_trivially_copyable<ValueType>::value,
+                      "only trees of trivially copyable keys and values can be loaded");
+        RedBlackTreeFileHeader
+            header;
+        std::ifstream
+            in(fileName,std::ios::binary);
+        size_t
+            pos = sizeof(header);
 
-        if (freeListHead == NULL_INDEX) {
-            auto
-                tmpLeft = new uint32_t[2*capacity];
-            auto
-                tmpRight = new uint32_t[2*capacity];
-            auto
-                tmpCounts = new uint32_t[2*capacity];
-            auto
-                tmpHeights = new uint32_t[2*capacity];
-            auto
-                tmpColors = new uint8_t[2*capacity];
-            auto
-                tmpKeys = new KeyType[2*capacity];
-            auto
-                tmpValues = new ValueType[2*capacity];
-
-            REPI(i,0,capacity) {
-                tmpLeft[i] = left[i];
-                tmpRight[i] = right[i];
-                tmpCounts[i] = counts[i];
-                tmpHeights[i] = heights[i];
-                tmpColors[i] = colors[i];
-                tmpKeys[i] = keys[i];
-                tmpValues[i] = values[i];
+        prvCheckNoSnapshots();
+
+        if (!in.read(reinterpret_cast<char *>(&header),sizeof(header)))
+            throw std::runtime_error("RedBlackTree: can't read " + fileName);
+
+        prvCheckHeader(header,fileName);
+
+        auto
+            p = new Pool(header.count);
+
+        p->store.forEachArray([&](auto *a) {
+            size_t
+                pad = (RBTREE_FILE_ALIGN - pos % RBTREE_FILE_ALIGN) % RBTREE_FILE_ALIGN;
+
+            in.ignore(pad);
+            in.read(reinterpret_cast<char *>(a),(size_t)header.count * sizeof(*a));
+            pos += pad + (size_t)header.count * sizeof(*a);
+        });
+
+        if (!in) {
+            delete p;
+            throw std::runtime_error("RedBlackTree: " + fileName + " is truncated");
+        }
+
+        try {
+            prvCheckLinks(p,header,fileName);
+        } catch (...) {
+            delete p;
+            throw;
+        }
+
+        // the pool's free list still links any slots past the saved nodes
+        p->freeListHead = (header.count < p->capacity) ? header.count : NULL_INDEX;
+        p->freeCount = p->capacity - header.count;
+
+        prvReplacePool(p,header.root);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    // replace the tree with a read-only view of a file saved by save(). the
+    // file is mapped into memory rather than read, so nothing is copied; the
+    // links are checked once when the file is mapped, and the rest of each
+    // node is only paged in as searches touch it. the mapping is private, so
+    // a value changed through search() changes only this process's copy
+    void mapFile(const std::string &fileName) {
+        static_assert(std::is_trivially_copyable<KeyType>::value &&
+                      std::is_trivially_copyable<ValueType>::value,
+                      "only trees of trivially copyable keys and values can be loaded");
+        RedBlackTreeFileHeader
+            header;
+        struct stat
+            st;
+        int
+            fd;
+
+        prvCheckNoSnapshots();
+
+        fd = open(fileName.c_str(),O_RDONLY);
+
+        if (fd < 0)
+            throw std::runtime_error("RedBlackTree: can't open " + fileName);
+
+        if (fstat(fd,&st) < 0 || (size_t)st.st_size < sizeof(header)) {
+            close(fd);
+            throw std::runtime_error("RedBlackTree: can't read " + fileName);
+        }
+
+        void
+            *base = mmap(nullptr,st.st_size,PROT_READ | PROT_WRITE,MAP_PRIVATE,fd,0);
+
+        close(fd);
+
+        if (base == MAP_FAILED)
+            throw std::runtime_error("RedBlackTree: can't map " + fileName);
+
+        memcpy(&header,base,sizeof(header));
+
+        try {
+            prvCheckHeader(header,fileName);
+
+            // the arrays must all fit inside the file
+            if (prvFileLength(header.count) > (size_t)st.st_size)
+                throw std::runtime_error("RedBlackTree: " + fileName + " is truncated");
+        } catch (...) {
+            munmap(base,st.st_size);
+            throw;
+        }
+
+        auto
+            p = new Pool(base,st.st_size,header.count);
+
+        try {
+            prvCheckLinks(p,header,fileName);
+        } catch (...) {
+            delete p;
+            throw;
+        }
+
+        prvReplacePool(p,header.root);
+    }
+#endif
+
+    // check every invariant in one iterative pass: key order, no red node
+    // with a red child, no red right links, equal black heights, and stored
+    // counts and heights. returns a description of each violation found; an
+    // empty list means the tree is valid. with parallel set, large trees are
+    // split into subtrees near the top that are checked on separate threads
+    std::vector<std::string> checkIntegrity(bool parallel=false) {
+        std::vector<std::string>
+            errors;
+        std::vector<std::pair<uint32_t,CheckSummary>>
+            done;
+        uint32_t
+            depth = 0;
+
+        if (root == NULL_INDEX)
+            return errors;
+
+        if (parallel && GET_COUNT(root) >= BATCH_PARALLEL_CUTOFF)
+            for (uint32_t t=std::thread::hardware_concurrency();t>1;t=(t+1)/2)
+                depth++;
+
+        if (depth > 0) {
+            std::vector<uint32_t>
+                level(1,root);
+
+            // the subtrees rooted depth levels down are checked first, each
+            // on its own thread
+            REPI(d,0,depth) {
+                std::vector<uint32_t>
+                    next;
+
+                for (uint32_t r : level)
+                    if (r < pool->capacity)
+                        for (uint32_t c : {left(r),right(r)})
+                            if (c != NULL_INDEX)
+                                next.push_back(c);
+
+                level.swap(next);
             }
 
-            delete[] values;
-            delete[] keys;
-            delete[] colors;
-            delete[] heights;
-            delete[] counts;
-            delete[] right;
-            delete[] left;
-
-            left = tmpLeft;
-            right = tmpRight;
-            counts = tmpCounts;
-            heights = tmpHeights;
-            colors = tmpColors;
-            keys = tmpKeys;
-            values = tmpValues;
+            std::vector<std::vector<std::string>>
+                subErrors(level.size());
+            std::vector<std::thread>
+                workers;
 
-            REPI(i,capacity,2*capacity-1)
-                left[i] = i + 1;
-            left[2*capacity-1] = NULL_INDEX;
+            done.resize(level.size());
 
-            freeListHead = capacity;
+            REPI(i,0,level.size())
+                workers.emplace_back([&,i] {
+                    done[i] = {level[i],prvCheckSubtree(level[i],{},subErrors[i])};
+                });
 
-            capacity *= 2;
+            for (auto &w : workers)
+                w.join();
+
+            for (auto &e : subErrors)
+                errors.insert(errors.end(),e.begin(),e.end());
         }
 
+        // then the top of the tree, using the subtree results
+        CheckSummary
+            top = prvCheckSubtree(root,done,errors);
+
+        if (IS_RED(root))
+            errors.push_back("root is red");
+
+        if (top.height > 2 * ceil(log2(top.count+1)))
+            errors.push_back("tree too tall: height " + std::to_string(top.height) + " for " +
+                             std::to_string(top.count) + " nodes");
+
+        return errors;
+    }
+
+    // throws logic_error describing the first violation (and how many more
+    // there are) if the tree isn't valid
+    void isValidRBTree() {
+        std::vector<std::string>
+            errors = checkIntegrity();
+
+        if (!errors.empty())
+            throw std::logic_error(errors[0] + ((errors.size() > 1) ?
+                " (and " + std::to_string(errors.size()-1) + " more)" : ""));
+    }
+
+private:
+    template <typename,typename,typename,typename>
+    friend class ConcurrentRedBlackTree;
+
+    void prvCheckWritable() {
+
+        if (isReadOnly())
+            throw std::logic_error("RedBlackTree: tree is read-only");
+    }
+
+    void prvCheckHeader(const RedBlackTreeFileHeader &header,const std::string &fileName) {
+
+        if (memcmp(header.magic,RBTREE_FILE_MAGIC,sizeof(header.magic)) != 0)
+            throw std::runtime_error("RedBlackTree: " + fileName + " is not a saved tree");
+        if (header.version != RBTREE_FILE_VERSION)
+            throw std::runtime_error("RedBlackTree: " + fileName + " has unsupported version " +
+                                     std::to_string(header.version));
+        if (header.layout != RedBlackTreeStorage<KeyType,ValueType,Layout>::LAYOUT_ID ||
+            header.keySize != sizeof(KeyType) || header.valueSize != sizeof(ValueType))
+            throw std::runtime_error("RedBlackTree: " + fileName + " was saved from a different tree type");
+    }
+
+    // bytes a saved tree of n nodes takes, laid out as save() writes it
+    static size_t prvFileLength(uint32_t n) {
+        RedBlackTreeStorage<KeyType,ValueType,Layout>
+            tmp;
+        size_t
+            pos = sizeof(RedBlackTreeFileHeader);
+
+        tmp.forEachArray([&](auto *&a) {
+            pos += (RBTREE_FILE_ALIGN - pos % RBTREE_FILE_ALIGN) % RBTREE_FILE_ALIGN;
+            pos += (size_t)n * sizeof(*a);
+        });
+
+        return pos;
+    }
+
+    // a search follows the root and links without checking them, so every
+    // one in a file must name a saved node
+    void prvCheckLinks(Pool *p,const RedBlackTreeFileHeader &header,const std::string &fileName) {
         uint32_t
-            tmp = freeListHead;
+            n = header.count;
+        auto
+            bad = [n](uint32_t r) { return r != NULL_INDEX && r >= n; };
 
-        freeListHead = left[freeListHead];
+        if (bad(header.root) || (n > 0 && header.root == NULL_INDEX))
+            throw std::runtime_error("RedBlackTree: " + fileName + " has a bad root");
 
-        left[tmp] = right[tmp] = NULL_INDEX;
-        counts[tmp] = heights[tmp] = 1;
-        colors[tmp] = NODE_RED;
+        REPI(i,0,n)
+            if (bad(p->store.left(i)) || bad(p->store.right(i)))
+                throw std::runtime_error("RedBlackTree: " + fileName + " has a bad link at node " +
+                                         std::to_string(i));
+    }
+
+    // snapshots hold node indices into the current pool, so it can't be
+    // swapped out from under them
+    void prvCheckNoSnapshots() {
+
+        if (liveSnapshots > 0)
+            throw std::logic_error("RedBlackTree: can't replace a tree that has live snapshots");
+    }
+
+    // optimistic readers load the root while a writer works, so it is
+    // stored atomically
+    void prvSetRoot(uint32_t r) { __atomic_store_n(&root,r,__ATOMIC_RELAXED); }
+
+    // swap in a pool loaded from a file; only a tree that owns its pool can
+    void prvReplacePool(Pool *p,uint32_t r) {
+
+        if (!ownsPool) {
+            delete p;
+            throw std::logic_error("RedBlackTree: can't load into a shared pool");
+        }
+
+        if (liveSnapshots > 0) {
+            delete p;
+            prvCheckNoSnapshots();
+        }
+
+        if (!isReadOnly())
+            prvRelease(root);
+
+        delete pool;
+
+        pool = p;
+        prvSetRoot(r);
+    }
+
+    template <typename QueryType>
+    uint32_t prvFind(uint32_t r,const QueryType &k) {
+
+        for (;r!=NULL_INDEX;) {
+            int
+                c = cmp(k,keys(r));
+
+            if (c == 0)
+                return r;
+            r = (c < 0) ? left(r) : right(r);
+        }
+
+        throw std::domain_error("Search: Key not found");
+    }
+
+    // node fields live in the pool. optimistic readers load links and counts
+    // while a writer works, so those are only changed through the setters
+    uint32_t left(uint32_t r) { return pool->store.left(r); }
+    uint32_t right(uint32_t r) { return pool->store.right(r); }
+    uint32_t counts(uint32_t r) { return pool->store.counts(r); }
+    void setLeft(uint32_t r,uint32_t v) { pool->store.storeLeft(r,v); }
+    void setRight(uint32_t r,uint32_t v) { pool->store.storeRight(r,v); }
+    void setCount(uint32_t r,uint32_t v) { pool->store.storeCount(r,v); }
+
+    // keys and values optimistic readers can copy are written with relaxed
+    // stores too; anything else is built, assigned or swapped in place
+    template <typename T,typename... Args>
+    static void prvConstruct(T &slot,Args &&...args) {
+
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            T
+                tmp(std::forward<Args>(args)...);
+
+            relaxedStore(&slot,tmp);
+        } else
+            new (&slot) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T,typename V>
+    static void prvAssign(T &slot,V &&v) {
+
+        if constexpr (std::is_trivially_copyable<T>::value)
+            relaxedStore<T>(&slot,v);
+        else
+            slot = std::forward<V>(v);
+    }
+
+    template <typename T>
+    static void prvSwap(T &a,T &b) {
+
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            T
+                tmp = a;
+
+            relaxedStore(&a,b);
+            relaxedStore(&b,tmp);
+        } else
+            std::swap(a,b);
+    }
+    uint32_t &heights(uint32_t r) { return pool->store.heights(r); }
+    uint8_t &colors(uint32_t r) { return pool->store.colors(r); }
+    KeyType &keys(uint32_t r) { return pool->store.keys(r); }
+    ValueType &values(uint32_t r) { return pool->store.values(r); }
+    uint32_t &refs(uint32_t r) { return pool->store.refs(r); }
+
+    uint32_t prvAllocate() {
+        uint32_t
+            tmp = pool->allocate();
+
+        setLeft(tmp,NULL_INDEX);
+        setRight(tmp,NULL_INDEX);
+        setCount(tmp,1);
+        heights(tmp) = refs(tmp) = 1;
+        colors(tmp) = NODE_RED;
 
         return tmp;
     }
+
+    // build the key and value of a freshly allocated node; if either throws,
+    // the node goes back to the pool
+    template <typename K,typename... Args>
+    void prvBuildNode(uint32_t r,K &&k,Args &&...args) {
+
+        try {
+            prvConstruct(keys(r),std::forward<K>(k));
+        } catch (...) {
+            pool->release(r);
+            throw;
+        }
+
+        try {
+            prvConstruct(values(r),std::forward<Args>(args)...);
+        } catch (...) {
+            keys(r).~KeyType();
+            pool->release(r);
+            throw;
+        }
+    }
+
     void prvFree(uint32_t r) {
 
-        left[r] = freeListHead;
-        freeListHead = r;
+        keys(r).~KeyType();
+        values(r).~ValueType();
+
+        pool->release(r);
     }
 
-    void prvClear(uint32_t r) {
+    // drop one link to r; once nothing links to a node, it is freed and its
+    // links to its children are dropped in turn
+    void prvRelease(uint32_t r) {
 
-        if (r != NULL_INDEX) {
-            prvClear(left[r]);
-            prvClear(right[r]);
+        if (r != NULL_INDEX && --refs(r) == 0) {
+            prvRelease(left(r));
+            prvRelease(right(r));
 
             prvFree(r);
         }
     }
 
-    void prvMap(uint32_t r,void (*fp)(const KeyType &,ValueType &)) {
+    // copy on write: return a node that only the caller links to, copying r
+    // if a snapshot can also reach it. the caller must replace its link to r
+    // with the result. this is only sound top-down: a node's count says how
+    // many parents link to it, so it only means "not shared" once the parent
+    // itself is known not to be shared
+    uint32_t prvMut(uint32_t r) {
+        uint32_t
+            tmp;
+
+        if (r == NULL_INDEX || refs(r) == 1)
+            return r;
+
+        tmp = prvAllocate();
+
+        prvBuildNode(tmp,keys(r),values(r));
+
+        setLeft(tmp,left(r));
+        setRight(tmp,right(r));
+        colors(tmp) = colors(r);
+        setCount(tmp,counts(r));
+        heights(tmp) = heights(r);
+
+        if (left(tmp) != NULL_INDEX)
+            refs(left(tmp))++;
+        if (right(tmp) != NULL_INDEX)
+            refs(right(tmp))++;
+
+        refs(r)--;
+
+        return tmp;
+    }
+
+    // map may change values, so nodes it visits are unshared first
+    uint32_t prvMap(uint32_t r,void (*fp)(const KeyType &,ValueType &)) {
+        uint32_t
+            tmp;
 
         if (r != NULL_INDEX) {
-            prvMap(left[r],fp);
+            r = prvMut(r);
 
-            (*fp)(keys[r],values[r]);
+            tmp = prvMap(left(r),fp);
+            setLeft(r,tmp);
 
-            prvMap(right[r],fp);
+            (*fp)(keys(r),values(r));
+
+            tmp = prvMap(right(r),fp);
+            setRight(r,tmp);
         }
+
+        return r;
+    }
+
+    void prvVisit(uint32_t r,void (*fp)(const KeyType &,const ValueType &)) {
+
+        if (r != NULL_INDEX) {
+            prvVisit(left(r),fp);
+
+            (*fp)(keys(r),values(r));
+
+            prvVisit(right(r),fp);
+        }
+    }
+
+    // list the nodes in order for a rebuild. nodes only this tree can reach
+    // are reused; nodes shared with a snapshot are left to it and copied
+    void prvGather(uint32_t r,bool exclusive,uint32_t *out,uint32_t &n) {
+
+        if (r == NULL_INDEX)
+            return;
+
+        bool
+            mine = exclusive && refs(r) == 1;
+
+        // the tree's link to this shared subtree goes away with the rebuild
+        if (exclusive && !mine)
+            refs(r)--;
+
+        prvGather(left(r),mine,out,n);
+
+        if (mine)
+            out[n++] = r;
+        else {
+            uint32_t
+                tmp = prvAllocate();
+
+            prvConstruct(keys(tmp),keys(r));
+            prvConstruct(values(tmp),values(r));
+
+            out[n++] = tmp;
+        }
+
+        prvGather(right(r),mine,out,n);
+    }
+
+    // parallel merge sort of batch positions
+    static void prvSortBatch(uint32_t *idx,uint32_t n,const KeyType *k,uint32_t depth,
+                             const Compare &cmp) {
+        auto
+            less = [k,&cmp](uint32_t a,uint32_t b) { return cmp(k[a],k[b]) < 0; };
+
+        if (depth == 0 || n < BATCH_PARALLEL_CUTOFF) {
+            std::stable_sort(idx,idx+n,less);
+            return;
+        }
+
+        uint32_t
+            half = n / 2;
+        std::thread
+            t(prvSortBatch,idx,half,k,depth-1,std::cref(cmp));
+
+        prvSortBatch(idx+half,n-half,k,depth-1,cmp);
+
+        t.join();
+
+        std::inplace_merge(idx,idx+half,idx+n,less);
+    }
+
+    // build a left-leaning red-black tree over n sorted nodes with black height
+    // bh, i.e. a 2-3 tree holding between 2^bh-1 and 3^bh-1 keys. the root is a
+    // 2-node unless its two subtrees can't hold the other n-1 keys, in which
+    // case it becomes a 3-node (black node with a red left child). subtrees
+    // touch disjoint nodes, so the top few levels are built in parallel
+    uint32_t prvBuild(const uint32_t *order,uint32_t n,uint32_t bh,uint32_t depth) {
+        uint32_t
+            subCap = 0,
+            sizes[3],
+            roots[3];
+
+        if (n == 0)
+            return NULL_INDEX;
+
+        for (uint32_t i=1,p=3;i<bh;i++,p*=3)
+            subCap = p - 1;
+
+        bool
+            isThree = n - 1 > 2 * subCap;
+
+        if (isThree) {
+            sizes[0] = (n - 2) / 3 + ((n - 2) % 3 > 0);
+            sizes[1] = (n - 2) / 3 + ((n - 2) % 3 > 1);
+            sizes[2] = (n - 2) / 3;
+        } else {
+            sizes[0] = n / 2;
+            sizes[1] = n - 1 - sizes[0];
+        }
+
+        uint32_t
+            nSubtrees = isThree ? 3 : 2,
+            offsets[3] = {0,sizes[0]+1,sizes[0]+sizes[1]+2};
+
+        if (depth > 0 && n >= BATCH_PARALLEL_CUTOFF) {
+            std::thread
+                t([&] { roots[0] = prvBuild(order,sizes[0],bh-1,depth-1); });
+
+            REPI(i,1,nSubtrees)
+                roots[i] = prvBuild(order+offsets[i],sizes[i],bh-1,depth-1);
+
+            t.join();
+        } else
+            REPI(i,0,nSubtrees)
+                roots[i] = prvBuild(order+offsets[i],sizes[i],bh-1,0);
+
+        uint32_t
+            r = order[offsets[1]-1];
+
+        setLeft(r,roots[0]);
+        setRight(r,roots[1]);
+        colors(r) = NODE_BLACK;
+        prvAdjust(r);
+
+        if (isThree) {
+            uint32_t
+                s = order[offsets[2]-1];
+
+            colors(r) = NODE_RED;
+            setLeft(s,r);
+            setRight(s,roots[2]);
+            colors(s) = NODE_BLACK;
+            prvAdjust(s);
+
+            r = s;
+        }
+
+        return r;
     }
 
     void prvAdjust(uint32_t r) {
         uint32_t
-            lc = GET_COUNT(left[r]),
-            rc = GET_COUNT(right[r]),
-            lh = GET_HEIGHT(left[r]),
-            rh = GET_HEIGHT(right[r]);
+            lc = GET_COUNT(left(r)),
+            rc = GET_COUNT(right(r)),
+            lh = GET_HEIGHT(left(r)),
+            rh = GET_HEIGHT(right(r));
 
-        counts[r] = 1 + lc + rc;
-        heights[r] = 1 + ((lh > rh) ? lh : rh);
+        setCount(r,1 + lc + rc);
+        heights(r) = 1 + ((lh > rh) ? lh : rh);
     }
 
     uint32_t prvRotateLeft(uint32_t r) {
         uint32_t
-            s = right[r];
+            s;
+
+        r = prvMut(r);
+        s = prvMut(right(r));
 
-        right[r] = left[s];
-        left[s] = r;
+        setRight(r,left(s));
+        setLeft(s,r);
 
-        colors[s] = colors[r];
-        colors[r] = NODE_RED;
+        colors(s) = colors(r);
+        colors(r) = NODE_RED;
 
         prvAdjust(r);
         prvAdjust(s);
@@ -269,13 +1605,16 @@ private:
 
     uint32_t prvRotateRight(uint32_t r) {
         uint32_t
-            q = left[r];
+            q;
 
-        left[r] = right[q];
-        right[q] = r;
+        r = prvMut(r);
+        q = prvMut(left(r));
 
-        colors[q] = colors[r];
-        colors[r] = NODE_RED;
+        setLeft(r,right(q));
+        setRight(q,r);
+
+        colors(q) = colors(r);
+        colors(r) = NODE_RED;
 
         prvAdjust(r);
         prvAdjust(q);
@@ -284,19 +1623,26 @@ private:
     }
 
     void prvFlipColors(uint32_t r) {
+        uint32_t
+            tmp;
+
+        tmp = prvMut(left(r));
+        setLeft(r,tmp);
+        tmp = prvMut(right(r));
+        setRight(r,tmp);
 
-        colors[r] = !colors[r];
-        colors[left[r]] = !colors[left[r]];
-        colors[right[r]] = !colors[right[r]];
+        colors(r) = !colors(r);
+        colors(left(r)) = !colors(left(r));
+        colors(right(r)) = !colors(right(r));
     }
 
     uint32_t prvBalance(uint32_t r) {
 
-        if (IS_RED(right[r]) && !IS_RED(left[r]))
+        if (IS_RED(right(r)) && !IS_RED(left(r)))
             r = prvRotateLeft(r);
-        if (IS_RED(left[r]) && IS_RED(left[left[r]]))
+        if (IS_RED(left(r)) && IS_RED(left(left(r))))
             r = prvRotateRight(r);
-        if (IS_RED(left[r]) && IS_RED(right[r]))
+        if (IS_RED(left(r)) && IS_RED(right(r)))
             prvFlipColors(r);
 
         prvAdjust(r);
@@ -307,8 +1653,11 @@ private:
     uint32_t prvMoveRedLeft(uint32_t r) {
 
         prvFlipColors(r);
-        if (IS_RED(left[right[r]])) {
-            right[r] = prvRotateRight(right[r]);
+        if (IS_RED(left(right(r)))) {
+            uint32_t
+                tmp = prvRotateRight(right(r));
+
+            setRight(r,tmp);
             r = prvRotateLeft(r);
             prvFlipColors(r);
         }
@@ -319,7 +1668,7 @@ private:
     uint32_t prvMoveRedRight(uint32_t r) {
 
         prvFlipColors(r);
-        if (IS_RED(left[left[r]])) {
+        if (IS_RED(left(left(r)))) {
             r = prvRotateRight(r);
             prvFlipColors(r);
         }
@@ -327,158 +1676,292 @@ private:
         return r;
     }
 
-    uint32_t prvInsert(uint32_t r,const KeyType &k) {
+    // k is only used to build the key if a node is created; args are only
+    // used to build its value. the caller must have called prvReserveInsert(),
+    // so nothing here allocates more than the pool holds, and every node the
+    // way back up changes is unshared on the way down. so only the way down
+    // can throw (building a key or value, or comparing keys), and then each
+    // level drops the copy prvMut made of its node and gives the original its
+    // link back, which leaves the tree and its snapshots as they were
+    template <typename K,typename... Args>
+    uint32_t prvInsert(uint32_t r,K &&k,uint32_t &node,bool &inserted,Args &&...args) {
         uint32_t
-            tmp;
+            tmp,
+            orig = r;
 
         if (r == NULL_INDEX) {
             tmp = prvAllocate();
 
-            keys[tmp] = k;
+            prvBuildNode(tmp,std::forward<K>(k),std::forward<Args>(args)...);
+
+            node = tmp;
+            inserted = true;
 
             return tmp;
         }
 
-        if (k == keys[r])
-            return r;
+        r = prvMut(r);
 
-        if (k < keys[r]) {
-            // why split these? because left might change inside prvInsert
-            // so must guarantee proper order
-            tmp = prvInsert(left[r],k);
-            left[r] = tmp;
-        } else {
-            tmp = prvInsert(right[r],k);
-            right[r] = tmp;
+        // nothing below this level changes until the new node is built, so
+        // only the copy needs undoing
+        try {
+            int
+                c = cmp(k,keys(r));
+
+            if (c == 0) {
+                node = r;
+                inserted = false;
+                return r;
+            }
+
+            if (c < 0) {
+                // why split these? because left might change inside prvInsert
+                // so must guarantee proper order
+                tmp = prvInsert(left(r),std::forward<K>(k),node,inserted,std::forward<Args>(args)...);
+                setLeft(r,tmp);
+            } else {
+                // if the right side comes back red, prvBalance flips colors
+                // and unshares a red left child; do that now, while a copy
+                // that throws can still be undone
+                if (IS_RED(left(r))) {
+                    tmp = prvMut(left(r));
+                    setLeft(r,tmp);
+                }
+
+                tmp = prvInsert(right(r),std::forward<K>(k),node,inserted,std::forward<Args>(args)...);
+                setRight(r,tmp);
+            }
+        } catch (...) {
+            if (r != orig) {
+                refs(orig)++;
+                prvRelease(r);
+            }
+            throw;
         }
 
         return prvBalance(r);
     }
 
+    // an insert allocates its new node and, while snapshots share nodes, at
+    // most two copies per level. room for all of them is made first, so none
+    // can fail once the tree has started to change
+    void prvReserveInsert() {
+
+        pool->reserve((liveSnapshots > 0) ? 2 * GET_HEIGHT(root) + 2 : 1);
+    }
+
     uint32_t prvRemoveMin(uint32_t r,uint32_t &ntbd) {
+        uint32_t
+            tmp;
+
+        r = prvMut(r);
 
-        if (left[r] == NULL_INDEX) {
+        if (left(r) == NULL_INDEX) {
             ntbd = r;
 
             return NULL_INDEX;
         }
 
-        if (!IS_RED(left[r]) && !IS_RED(left[left[r]]))
+        if (!IS_RED(left(r)) && !IS_RED(left(left(r))))
             r = prvMoveRedLeft(r);
 
-        left[r] = prvRemoveMin(left[r],ntbd);
+        tmp = prvRemoveMin(left(r),ntbd);
+        setLeft(r,tmp);
 
         return prvBalance(r);
     }
 
     uint32_t prvRemove(uint32_t r,uint32_t &ntbd,const KeyType &k) {
+        uint32_t
+            tmp;
 
-        if (k < keys[r]) {
-            if (!IS_RED(left[r]) && !IS_RED(left[left[r]]))
+        r = prvMut(r);
+
+        if (cmp(k,keys(r)) < 0) {
+            if (!IS_RED(left(r)) && !IS_RED(left(left(r))))
                 r = prvMoveRedLeft(r);
-            left[r] = prvRemove(left[r],ntbd,k);
+            tmp = prvRemove(left(r),ntbd,k);
+            setLeft(r,tmp);
         } else {
-            if (IS_RED(left[r]))
+            if (IS_RED(left(r)))
                 r = prvRotateRight(r);
-            if (k == keys[r] && right[r] == NULL_INDEX) {
+
+            // rotations change r, so compare again after each one
+            int
+                c = cmp(k,keys(r));
+
+            if (c == 0 && right(r) == NULL_INDEX) {
                 ntbd = r;
                 return NULL_INDEX;
             }
-            if (!IS_RED(right[r]) && !IS_RED(left[right[r]]))
+            if (!IS_RED(right(r)) && !IS_RED(left(right(r)))) {
                 r = prvMoveRedRight(r);
-            if (k == keys[r]) {
-                uint32_t
-                    tmp = right[r];
-
-                while (left[tmp] != NULL_INDEX)
-                    tmp = left[tmp];
-
-                keys[r] = keys[tmp];
-                values[r] = values[tmp];
-
-                right[r] = prvRemoveMin(right[r],ntbd);
-            } else
-                right[r] = prvRemove(right[r],ntbd,k);
+                c = cmp(k,keys(r));
+            }
+            if (c == 0) {
+                // unlink the successor first, which unshares it, then swap
+                // rather than copy; the removed node takes the old key and
+                // value with it
+                tmp = prvRemoveMin(right(r),ntbd);
+                setRight(r,tmp);
+
+                prvSwap(keys(r),keys(ntbd));
+                prvSwap(values(r),values(ntbd));
+            } else {
+                tmp = prvRemove(right(r),ntbd,k);
+                setRight(r,tmp);
+            }
         }
 
         return prvBalance(r);
     }
 
-    void prvIsValid(uint32_t r,uint32_t &leafDepth,uint32_t curDepth) {
-
-        if (r == NULL_INDEX) {
-            if (leafDepth == NULL_INDEX)
-                leafDepth = curDepth;
-            if (leafDepth != curDepth)
-                throw std::logic_error("leaves at different levels " + std::to_string(leafDepth)
-                    + " and " + std::to_string(curDepth));
-
-            return;
+    struct CheckSummary {
+        uint32_t
+            count,
+            height,
+            blackHeight,
+            minNode,
+            maxNode;
+    };
+
+    // post-order walk with an explicit stack, so deep or damaged trees can't
+    // overflow the call stack. subtrees listed in done were already checked
+    // and are not entered again
+    CheckSummary prvCheckSubtree(uint32_t start,const std::vector<std::pair<uint32_t,CheckSummary>> &done,
+                                 std::vector<std::string> &errors) {
+        struct Frame {
+            uint32_t
+                r,
+                stage;
+            CheckSummary
+                sub[2];
+        };
+        std::vector<Frame>
+            stack;
+        CheckSummary
+            top = {0,0,0,NULL_INDEX,NULL_INDEX};
+        uint32_t
+            prev = NULL_INDEX;
+        uint64_t
+            steps = 0;
+
+        auto
+            report = [&](uint32_t r,const std::string &msg) {
+                errors.push_back("node " + std::to_string(r) + ": " + msg);
+            };
+
+        // start on child c; its summary goes in slot now if it needs no
+        // walking, otherwise when its frame finishes
+        auto
+            descend = [&](uint32_t c,CheckSummary &slot) {
+                slot = {0,0,0,NULL_INDEX,NULL_INDEX};
+
+                if (c == NULL_INDEX)
+                    return;
+
+                if (c >= pool->capacity) {
+                    report(c,"link out of range");
+                    return;
+                }
+
+                for (auto &d : done)
+                    if (d.first == c) {
+                        slot = d.second;
+
+                        // a walk cut short (by a cycle) has no key range
+                        if (slot.count == 0 || slot.minNode == NULL_INDEX || slot.maxNode == NULL_INDEX) {
+                            report(c,"subtree walk stopped early; its key order wasn't checked");
+                            return;
+                        }
+
+                        if (prev != NULL_INDEX && cmp(keys(prev),keys(slot.minNode)) >= 0)
+                            report(slot.minNode,"key out of order");
+                        prev = slot.maxNode;
+                        return;
+                    }
+
+                // more steps than nodes means the links loop
+                if (++steps > pool->capacity) {
+                    report(c,"links form a cycle");
+                    stack.clear();
+                    return;
+                }
+
+                stack.push_back({c,0,{}});
+            };
+
+        descend(start,top);
+
+        while (!stack.empty()) {
+            size_t
+                i = stack.size() - 1;
+            uint32_t
+                r = stack[i].r;
+
+            if (stack[i].stage == 0) {
+                stack[i].stage = 1;
+                descend(left(r),stack[i].sub[0]);
+            } else if (stack[i].stage == 1) {
+                stack[i].stage = 2;
+
+                // in-order: each key must be larger than the one before it
+                if (prev != NULL_INDEX && cmp(keys(prev),keys(r)) >= 0)
+                    report(r,"key out of order");
+                prev = r;
+
+                descend(right(r),stack[i].sub[1]);
+            } else {
+                CheckSummary
+                    &lc = stack[i].sub[0],
+                    &rc = stack[i].sub[1],
+                    s;
+
+                if (IS_RED(r) && (IS_RED(left(r)) || IS_RED(right(r))))
+                    report(r,"red node has a red child");
+                if (IS_RED(right(r)))
+                    report(r,"red right link");
+                if (lc.blackHeight != rc.blackHeight)
+                    report(r,"black heights differ: " + std::to_string(lc.blackHeight) + " left, " +
+                             std::to_string(rc.blackHeight) + " right");
+
+                s.count = 1 + lc.count + rc.count;
+                s.height = 1 + ((lc.height > rc.height) ? lc.height : rc.height);
+                s.blackHeight = ((lc.blackHeight > rc.blackHeight) ? lc.blackHeight : rc.blackHeight) +
+                                (IS_RED(r) ? 0 : 1);
+                s.minNode = (lc.count > 0) ? lc.minNode : r;
+                s.maxNode = (rc.count > 0) ? rc.maxNode : r;
+
+                if (counts(r) != s.count)
+                    report(r,"count is " + std::to_string(counts(r)) + ", should be " + std::to_string(s.count));
+                if (heights(r) != s.height)
+                    report(r,"height is " + std::to_string(heights(r)) + ", should be " +
+                             std::to_string(s.height));
+
+                stack.pop_back();
+
+                if (stack.empty())
+                    top = s;
+                else
+                    stack.back().sub[stack.back().stage-1] = s;
+            }
         }
 
-        if (IS_RED(r) && (IS_RED(left[r])) || IS_RED(right[r]))
-            throw std::logic_error("red rule violation");
-
-        if (left[r] != NULL_INDEX && keys[left[r]] >= keys[r])
-            throw std::logic_error("left child not less");
-
-        if (right[r] != NULL_INDEX && keys[right[r]] <= keys[r])
-            throw std::logic_error("right child not larger");
-
-        prvIsValid(left[r],leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
-        prvIsValid(right[r],leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
+        return top;
     }
 
-    uint32_t
-        root;
+    Pool
+        *pool;
 
-    [[maybe_unused]] static uint32_t
-        *left,
-        *right,
-        *counts,
-        *heights,
-        nTrees,
-        freeListHead,
-        capacity;
+    bool
+        ownsPool;
 
-    static uint8_t
-        *colors;
-
-    [[maybe_unused]] static KeyType
-        *keys;
+    uint32_t
+        root,
+        liveSnapshots = 0;              // snapshots still holding nodes of this pool
 
-    [[maybe_unused]] static ValueType
-        *values;
+    Compare
+        cmp;
 };
 
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::capacity = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::freeListHead = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::nTrees = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::left = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::right = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::counts = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::heights = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint8_t *RedBlackTree<KeyType,ValueType>::colors = nullptr;
-
-template <typename KeyType,typename ValueType>
-KeyType *RedBlackTree<KeyType,ValueType>::keys = nullptr;
-
-template <typename KeyType,typename ValueType>
-ValueType *RedBlackTree<KeyType,ValueType>::values = nullptr;
-
 #endif //REDBLACKTREE_H
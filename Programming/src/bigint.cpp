@@ -0,0 +1,440 @@
+#include <bigint.h>
+
+#include <algorithm>
+#include <cctype>
+
+void BigInt::prvSet(__int128 v) {
+    unsigned __int128
+        m;
+
+    neg = v < 0;
+    m = neg ? -(unsigned __int128)v : (unsigned __int128)v;
+
+    mag.clear();
+    while (m != 0) {
+        mag.push_back((uint32_t)m);
+        m >>= 32;
+    }
+}
+
+BigInt::BigInt(const std::string &s) : neg(false) {
+    size_t
+        i = 0;
+    bool
+        minus = false;
+
+    if (i < s.length() && (s[i] == '-' || s[i] == '+'))
+        minus = s[i++] == '-';
+
+    if (i == s.length())
+        throw std::domain_error("BigInt: no digits");
+
+    // nine digits at a time: *this = *this * 10^k + chunk
+    while (i < s.length()) {
+        uint32_t
+            chunk = 0,
+            scale = 1;
+        uint64_t
+            carry;
+
+        for (uint32_t k=0;k<9&&i<s.length();k++,i++) {
+            if (!isdigit((unsigned char)s[i]))
+                throw std::domain_error("BigInt: bad digit");
+            chunk = chunk * 10 + (s[i] - '0');
+            scale *= 10;
+        }
+
+        carry = chunk;
+        for (auto &limb : mag) {
+            carry += (uint64_t)limb * scale;
+            limb = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry != 0)
+            mag.push_back((uint32_t)carry);
+    }
+
+    prvTrim();
+    neg = minus && !mag.empty();
+}
+
+void BigInt::prvTrim() {
+
+    while (!mag.empty() && mag.back() == 0)
+        mag.pop_back();
+
+    if (mag.empty())
+        neg = false;
+}
+
+int BigInt::prvCompareMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b) {
+
+    if (a.size() != b.size())
+        return (a.size() < b.size()) ? -1 : 1;
+
+    for (size_t i=a.size();i-->0;)
+        if (a[i] != b[i])
+            return (a[i] < b[i]) ? -1 : 1;
+
+    return 0;
+}
+
+int BigInt::compare(const BigInt &rhs) const {
+
+    if (neg != rhs.neg)
+        return neg ? -1 : 1;
+
+    return neg ? prvCompareMag(rhs.mag,mag) : prvCompareMag(mag,rhs.mag);
+}
+
+void BigInt::prvAddMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                       std::vector<uint32_t> &out) {
+    const std::vector<uint32_t>
+        &longer = (a.size() >= b.size()) ? a : b,
+        &shorter = (a.size() >= b.size()) ? b : a;
+    std::vector<uint32_t>
+        sum(longer.size() + 1);
+    uint64_t
+        carry = 0;
+
+    for (size_t i=0;i<longer.size();i++) {
+        carry += (uint64_t)longer[i] + ((i < shorter.size()) ? shorter[i] : 0);
+        sum[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum[longer.size()] = (uint32_t)carry;
+
+    out.swap(sum);
+}
+
+// a must be at least b
+void BigInt::prvSubMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                       std::vector<uint32_t> &out) {
+    std::vector<uint32_t>
+        diff(a.size());
+    int64_t
+        borrow = 0;
+
+    for (size_t i=0;i<a.size();i++) {
+        int64_t
+            t = (int64_t)a[i] - borrow - ((i < b.size()) ? b[i] : 0);
+
+        borrow = (t < 0) ? 1 : 0;
+        diff[i] = (uint32_t)t;
+    }
+
+    out.swap(diff);
+}
+
+BigInt BigInt::operator+(const BigInt &rhs) const {
+    BigInt
+        r;
+
+    if (neg == rhs.neg) {
+        prvAddMag(mag,rhs.mag,r.mag);
+        r.neg = neg;
+    } else if (prvCompareMag(mag,rhs.mag) >= 0) {
+        prvSubMag(mag,rhs.mag,r.mag);
+        r.neg = neg;
+    } else {
+        prvSubMag(rhs.mag,mag,r.mag);
+        r.neg = rhs.neg;
+    }
+
+    r.prvTrim();
+
+    return r;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt
+        r = *this;
+
+    r.neg = !neg && !mag.empty();
+
+    return r;
+}
+
+BigInt BigInt::operator-(const BigInt &rhs) const {
+
+    return *this + (-rhs);
+}
+
+// schoolbook; fraction operands rarely run to more than a few limbs
+BigInt BigInt::operator*(const BigInt &rhs) const {
+    BigInt
+        r;
+
+    if (mag.empty() || rhs.mag.empty())
+        return r;
+
+    r.mag.assign(mag.size() + rhs.mag.size(),0);
+
+    for (size_t i=0;i<mag.size();i++) {
+        uint64_t
+            carry = 0;
+
+        for (size_t j=0;j<rhs.mag.size();j++) {
+            carry += (uint64_t)mag[i] * rhs.mag[j] + r.mag[i+j];
+            r.mag[i+j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r.mag[i+rhs.mag.size()] = (uint32_t)carry;
+    }
+
+    r.neg = neg != rhs.neg;
+    r.prvTrim();
+
+    return r;
+}
+
+// Knuth's algorithm D (TAOCP vol. 2, 4.3.1): normalize so the divisor's top
+// limb has its high bit set, then estimate each quotient limb from the top
+// two limbs of the remainder, correcting the estimate at most twice
+void BigInt::prvDivModMag(const std::vector<uint32_t> &a,const std::vector<uint32_t> &b,
+                          std::vector<uint32_t> &q,std::vector<uint32_t> &r) {
+    size_t
+        m = a.size(),
+        n = b.size();
+
+    if (m < n) {
+        q.clear();
+        r = a;
+        return;
+    }
+
+    q.assign(m - n + 1,0);
+
+    // one-limb divisor: short division
+    if (n == 1) {
+        uint64_t
+            rem = 0;
+
+        for (size_t i=m;i-->0;) {
+            rem = (rem << 32) | a[i];
+            q[i] = (uint32_t)(rem / b[0]);
+            rem %= b[0];
+        }
+
+        r.assign(1,(uint32_t)rem);
+        return;
+    }
+
+    int
+        s = __builtin_clz(b[n-1]);
+    std::vector<uint32_t>
+        un(m + 1),
+        vn(n);
+
+    for (size_t i=n-1;i>0;i--)
+        vn[i] = (b[i] << s) | (s ? (uint32_t)((uint64_t)b[i-1] >> (32 - s)) : 0);
+    vn[0] = b[0] << s;
+
+    un[m] = s ? (uint32_t)((uint64_t)a[m-1] >> (32 - s)) : 0;
+    for (size_t i=m-1;i>0;i--)
+        un[i] = (a[i] << s) | (s ? (uint32_t)((uint64_t)a[i-1] >> (32 - s)) : 0);
+    un[0] = a[0] << s;
+
+    for (size_t j=m-n+1;j-->0;) {
+        uint64_t
+            num = ((uint64_t)un[j+n] << 32) | un[j+n-1],
+            qhat = num / vn[n-1],
+            rhat = num % vn[n-1];
+        int64_t
+            borrow = 0,
+            t;
+
+        while (qhat >= ((uint64_t)1 << 32) ||
+               qhat * vn[n-2] > ((rhat << 32) | un[j+n-2])) {
+            qhat--;
+            rhat += vn[n-1];
+            if (rhat >= ((uint64_t)1 << 32))
+                break;
+        }
+
+        // un[j..j+n] -= qhat * vn
+        for (size_t i=0;i<n;i++) {
+            uint64_t
+                p = qhat * vn[i];
+
+            t = (int64_t)un[i+j] - borrow - (int64_t)(p & 0xffffffff);
+            un[i+j] = (uint32_t)t;
+            borrow = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j+n] - borrow;
+        un[j+n] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+
+        // estimate was one too big: add the divisor back
+        if (t < 0) {
+            uint64_t
+                carry = 0;
+
+            q[j]--;
+            for (size_t i=0;i<n;i++) {
+                carry += (uint64_t)un[i+j] + vn[i];
+                un[i+j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            un[j+n] += (uint32_t)carry;
+        }
+    }
+
+    r.assign(n,0);
+    for (size_t i=0;i<n;i++)
+        r[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i+1] << (32 - s)) : 0);
+}
+
+void BigInt::divMod(const BigInt &a,const BigInt &b,BigInt &q,BigInt &r) {
+    BigInt
+        quot,
+        rem;
+
+    if (b.mag.empty())
+        throw std::domain_error("BigInt: division by zero");
+
+    prvDivModMag(a.mag,b.mag,quot.mag,rem.mag);
+
+    quot.neg = a.neg != b.neg;
+    rem.neg = a.neg;
+    quot.prvTrim();
+    rem.prvTrim();
+
+    q = quot;
+    r = rem;
+}
+
+BigInt BigInt::operator/(const BigInt &rhs) const {
+    BigInt
+        q,r;
+
+    divMod(*this,rhs,q,r);
+
+    return q;
+}
+
+BigInt BigInt::operator%(const BigInt &rhs) const {
+    BigInt
+        q,r;
+
+    divMod(*this,rhs,q,r);
+
+    return r;
+}
+
+bool BigInt::toInt128(__int128 &out) const {
+    unsigned __int128
+        m = 0;
+
+    if (mag.size() > 4)
+        return false;
+
+    for (size_t i=mag.size();i-->0;)
+        m = (m << 32) | mag[i];
+
+    // the magnitude of the most negative value is one more than the largest
+    if (m > ((unsigned __int128)1 << 127) - (neg ? 0 : 1))
+        return false;
+
+    out = neg ? (__int128)(-m) : (__int128)m;
+
+    return true;
+}
+
+std::string BigInt::toString() const {
+    std::vector<uint32_t>
+        m = mag,
+        q,
+        r;
+    std::string
+        s;
+    const std::vector<uint32_t>
+        billion(1,1000000000);
+
+    if (m.empty())
+        return "0";
+
+    // peel off nine digits at a time
+    while (!m.empty()) {
+        uint32_t
+            chunk;
+
+        prvDivModMag(m,billion,q,r);
+        chunk = r.empty() ? 0 : r[0];
+
+        while (!q.empty() && q.back() == 0)
+            q.pop_back();
+        m.swap(q);
+
+        for (int k=0;k<9&&(chunk!=0||!m.empty());k++) {
+            s += (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    }
+
+    if (neg)
+        s += '-';
+
+    std::reverse(s.begin(),s.end());
+
+    return s;
+}
+
+uint64_t BigInt::hash() const {
+    uint64_t
+        h = neg ? 1 : 0;
+
+    for (auto limb : mag)
+        h = (h ^ limb) * 0x100000001b3ull + (h >> 32);
+
+    return h;
+}
+
+BigInt abs(const BigInt &a) {
+
+    return a.isNegative() ? -a : a;
+}
+
+BigInt gcd(BigInt a,BigInt b) {
+    BigInt
+        r;
+
+    a = abs(a);
+    b = abs(b);
+
+    while (!b.isZero()) {
+        r = a % b;
+        a = b;
+        b = r;
+    }
+
+    return a;
+}
+
+std::istream &operator>>(std::istream &is,BigInt &b) {
+    std::string
+        s;
+
+    is >> std::ws;
+
+    if (is.peek() == '-' || is.peek() == '+')
+        s += (char)is.get();
+
+    while (isdigit(is.peek()))
+        s += (char)is.get();
+
+    if (s.empty() || !isdigit((unsigned char)s.back()))
+        is.setstate(std::ios::failbit);
+    else
+        b = BigInt(s);
+
+    return is;
+}
+
+std::ostream &operator<<(std::ostream &os,const BigInt &b) {
+
+    os << b.toString();
+
+    return os;
+}
@@ -1,78 +1,330 @@
 #include <fraction.h>
 
-static int gcd(int a,int b) {
-    int
-        r;
+#include <algorithm>
+
+// to print or read an __int128, go through BigInt
+template <typename T>
+static void putInt(std::ostream &os,const T &v) { os << v; }
+static void putInt(std::ostream &os,__int128 v) { os << BigInt(v); }
+
+template <typename T>
+static bool getInt(std::istream &is,T &v) { return (bool)(is >> v); }
+static bool getInt(std::istream &is,__int128 &v) {
+    BigInt
+        b;
 
-    a = (a >= 0) ? a : -a;
-    b = (b >= 0) ? b : -b;
+    if (!(is >> b))
+        return false;
 
-    while (b != 0) {
-        r = a % b;
-        a = b;
-        a = r;
+    if (!b.toInt128(v)) {
+        is.setstate(std::ios::failbit);
+        return false;
     }
 
-    return a;
+    return true;
 }
 
-Fraction::Fraction(int n,int d) {
-    int
-        g;
+template <typename IntType>
+std::istream &operator>>(std::istream &is,BasicFraction<IntType> &f) {
+    IntType
+        n,d;
+    char
+        slash;
+
+    if (getInt(is,n) && (is >> slash) && getInt(is,d))
+        f = BasicFraction<IntType>(n,d);
+
+    return is;
+}
+
+template <typename IntType>
+std::ostream &operator<<(std::ostream &os,const BasicFraction<IntType> &f) {
 
-    if (d < 0) {
-        n = -n;
-        d = -d;
+    putInt(os,f.getNum());
+    os << " / ";
+    putInt(os,f.getDen());
+
+    return os;
+}
+
+template std::istream &operator>>(std::istream &,BasicFraction<int32_t> &);
+template std::istream &operator>>(std::istream &,BasicFraction<int64_t> &);
+template std::istream &operator>>(std::istream &,BasicFraction<__int128> &);
+template std::istream &operator>>(std::istream &,BasicFraction<BigInt> &);
+template std::ostream &operator<<(std::ostream &,const BasicFraction<int32_t> &);
+template std::ostream &operator<<(std::ostream &,const BasicFraction<int64_t> &);
+template std::ostream &operator<<(std::ostream &,const BasicFraction<__int128> &);
+template std::ostream &operator<<(std::ostream &,const BasicFraction<BigInt> &);
+
+// fractionFromChars/fractionToChars: one integer at a time. the built-in
+// types use std::from_chars/to_chars; __int128 has no overload in strict
+// C++17, so it gets its own digit loops, and BigInt goes through a string
+
+template <typename T>
+static std::from_chars_result parseInt(const char *first,const char *last,T &v) {
+    return std::from_chars(first,last,v);
+}
+
+static std::from_chars_result parseInt(const char *first,const char *last,__int128 &v) {
+    typedef unsigned __int128 U;
+    const char
+        *p = first,
+        *digits;
+    bool
+        minus = (p != last && *p == '-'),
+        tooBig = false;
+    U
+        m = 0,
+        limit;
+
+    if (minus)
+        p++;
+    limit = ((U)1 << 127) - (minus ? 0 : 1);
+
+    for (digits=p;p!=last&&*p>='0'&&*p<='9';p++) {
+        uint32_t
+            digit = *p - '0';
+
+        if (m > (limit - digit) / 10)
+            tooBig = true;
+        else
+            m = m * 10 + digit;
     }
 
-    g = gcd(n,d);
+    if (p == digits)
+        return {first,std::errc::invalid_argument};
+
+    if (tooBig)
+        return {p,std::errc::result_out_of_range};
 
-    num = n / g;
-    den = d / g;
+    v = minus ? (__int128)(-m) : (__int128)m;
+
+    return {p,std::errc()};
 }
 
-Fraction Fraction::operator=(Fraction rhs) {
-    int32_t
-        s,t;
+static std::from_chars_result parseInt(const char *first,const char *last,BigInt &v) {
+    const char
+        *p = first,
+        *digits;
+
+    if (p != last && *p == '-')
+        p++;
+
+    for (digits=p;p!=last&&*p>='0'&&*p<='9';p++)
+        ;
 
-    num = rhs.num;
-    den = rhs.den;
+    if (p == digits)
+        return {first,std::errc::invalid_argument};
+
+    v = BigInt(std::string(first,p));
+
+    return {p,std::errc()};
+}
 
-    return Fraction(s,t);
+template <typename T>
+static std::to_chars_result formatInt(char *first,char *last,T v) {
+    return std::to_chars(first,last,v);
 }
 
-Fraction Fraction::operator+(Fraction rhs)  {
+static std::to_chars_result formatInt(char *first,char *last,__int128 v) {
+    unsigned __int128
+        m = (v < 0) ? -(unsigned __int128)v : (unsigned __int128)v;
+    char
+        buf[40];
     int
-        n,d;
+        n = 0;
+
+    do {
+        buf[n++] = (char)('0' + (int)(m % 10));
+        m /= 10;
+    } while (m != 0);
 
-    n = num * rhs.den + den * rhs.num;
-    d = den * rhs.den;
+    if (last - first < n + (v < 0))
+        return {last,std::errc::value_too_large};
 
-    return Fraction(n,d);
+    if (v < 0)
+        *first++ = '-';
+    while (n > 0)
+        *first++ = buf[--n];
+
+    return {first,std::errc()};
 }
 
-bool Fraction::operator==(Fraction rhs)  {
-    return num == rhs.num && den == rhs.den;
+static std::to_chars_result formatInt(char *first,char *last,const BigInt &v) {
+    std::string
+        s = v.toString();
+
+    if ((size_t)(last - first) < s.length())
+        return {last,std::errc::value_too_large};
+
+    return {std::copy(s.begin(),s.end(),first),std::errc()};
 }
 
-bool Fraction::operator!=(Fraction rhs)  {
-    return num != rhs.num && den != rhs.den;
+template <typename IntType>
+std::from_chars_result fractionFromChars(const char *first,const char *last,BasicFraction<IntType> &f) {
+    IntType
+        n = 0,
+        d = 1;
+    std::from_chars_result
+        r = parseInt(first,last,n);
+
+    if (r.ec != std::errc())
+        return r;
+
+    if (r.ptr != last && *r.ptr == '/') {
+        r = parseInt(r.ptr + 1,last,d);
+        if (r.ec == std::errc::invalid_argument)
+            return {first,r.ec};
+        if (r.ec != std::errc())
+            return r;
+    }
+
+    if (d == IntType(0))
+        return {first,std::errc::invalid_argument};
+
+    // only n/d with n or d the most negative value can fail to fit
+    try {
+        f = BasicFraction<IntType>(n,d);
+    } catch (const std::overflow_error &) {
+        return {r.ptr,std::errc::result_out_of_range};
+    }
+
+    return r;
 }
 
-std::istream &operator>>(std::istream &is,Fraction &f) {
-    int
+template <typename IntType>
+std::to_chars_result fractionToChars(char *first,char *last,const BasicFraction<IntType> &f) {
+    std::to_chars_result
+        r = formatInt(first,last,f.getNum());
+
+    if (r.ec != std::errc())
+        return r;
+
+    if (r.ptr == last)
+        return {last,std::errc::value_too_large};
+
+    *r.ptr = '/';
+
+    return formatInt(r.ptr + 1,last,f.getDen());
+}
+
+template std::from_chars_result fractionFromChars(const char *,const char *,BasicFraction<int32_t> &);
+template std::from_chars_result fractionFromChars(const char *,const char *,BasicFraction<int64_t> &);
+template std::from_chars_result fractionFromChars(const char *,const char *,BasicFraction<__int128> &);
+template std::from_chars_result fractionFromChars(const char *,const char *,BasicFraction<BigInt> &);
+template std::to_chars_result fractionToChars(char *,char *,const BasicFraction<int32_t> &);
+template std::to_chars_result fractionToChars(char *,char *,const BasicFraction<int64_t> &);
+template std::to_chars_result fractionToChars(char *,char *,const BasicFraction<__int128> &);
+template std::to_chars_result fractionToChars(char *,char *,const BasicFraction<BigInt> &);
+
+// ExactFraction: try the 64-bit operation, and redo it with BigInts if it
+// overflows. a BigFraction result that fits in 64 bits is stored as one
+
+ExactFraction::ExactFraction(const BigFraction &f) : isBig(false) {
+    __int128
         n,d;
-    char
-        slash;
 
-    is >> n >> slash >> d;
+    if (f.getNum().toInt128(n) && f.getDen().toInt128(d) &&
+        n >= INT64_MIN && n <= INT64_MAX && d <= INT64_MAX) {
+        small = Fraction64((int64_t)n,(int64_t)d);
+        return;
+    }
+
+    big = f;
+    isBig = true;
+}
+
+BigFraction ExactFraction::toBig() const {
+
+    return isBig ? big : BigFraction(BigInt(small.getNum()),BigInt(small.getDen()));
+}
+
+ExactFraction ExactFraction::operator+(const ExactFraction &rhs) const {
+
+    if (!isBig && !rhs.isBig)
+        try {
+            return ExactFraction(small + rhs.small);
+        } catch (const std::overflow_error &) { }
+
+    return ExactFraction(toBig() + rhs.toBig());
+}
+
+ExactFraction ExactFraction::operator-(const ExactFraction &rhs) const {
+
+    if (!isBig && !rhs.isBig)
+        try {
+            return ExactFraction(small - rhs.small);
+        } catch (const std::overflow_error &) { }
+
+    return ExactFraction(toBig() - rhs.toBig());
+}
+
+ExactFraction ExactFraction::operator*(const ExactFraction &rhs) const {
+
+    if (!isBig && !rhs.isBig)
+        try {
+            return ExactFraction(small * rhs.small);
+        } catch (const std::overflow_error &) { }
+
+    return ExactFraction(toBig() * rhs.toBig());
+}
+
+ExactFraction ExactFraction::operator/(const ExactFraction &rhs) const {
+
+    if (!isBig && !rhs.isBig)
+        try {
+            return ExactFraction(small / rhs.small);
+        } catch (const std::overflow_error &) { }
+
+    return ExactFraction(toBig() / rhs.toBig());
+}
+
+// values that fit in 64 bits are always stored small, so a small and a big
+// value are never equal
+bool ExactFraction::operator==(const ExactFraction &rhs) const {
+
+    if (isBig != rhs.isBig)
+        return false;
+
+    return isBig ? big == rhs.big : small == rhs.small;
+}
+
+bool ExactFraction::operator!=(const ExactFraction &rhs) const {
+
+    return !(*this == rhs);
+}
+
+bool ExactFraction::operator<=(const ExactFraction &rhs) const {
+
+    return (isBig || rhs.isBig) ? toBig() <= rhs.toBig() : small <= rhs.small;
+}
+
+bool ExactFraction::operator>=(const ExactFraction &rhs) const {
+
+    return (isBig || rhs.isBig) ? toBig() >= rhs.toBig() : small >= rhs.small;
+}
+
+bool ExactFraction::operator<(const ExactFraction &rhs) const {
+
+    return (isBig || rhs.isBig) ? toBig() < rhs.toBig() : small < rhs.small;
+}
+
+bool ExactFraction::operator>(const ExactFraction &rhs) const {
+
+    return (isBig || rhs.isBig) ? toBig() > rhs.toBig() : small > rhs.small;
+}
+
+std::istream &operator>>(std::istream &is,ExactFraction &f) {
+    BigFraction
+        b;
 
-    f = Fraction(n,d);
+    if (is >> b)
+        f = ExactFraction(b);
 
     return is;
 }
 
-std::ostream &operator<<(std::ostream &os,Fraction f) {
+std::ostream &operator<<(std::ostream &os,const ExactFraction &f) {
 
     os << f.getNum() << " / " << f.getDen();
 
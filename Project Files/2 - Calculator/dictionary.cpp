@@ -2,71 +2,69 @@
 // Created by rwkramer on 9/23/22.
 //
 
+#include <cstring>
 #include "dictionary.h"
 
-static uint32_t hash(const std::string &s) {
-    uint32_t
-        sum = 0;
-
-    for (uint32_t i=0;i<s.length();i++)
-        sum = sum * i + s[i];
-
-    return sum;
+static const uint64_t
+    HASH_SEED = 0xa0761d6478bd642full,
+    HASH_P1 = 0xe7037ed1a0b428dbull,
+    HASH_P2 = 0x8ebc6af09c88c6e3ull,
+    HASH_P3 = 0x589965cc75374cc3ull;
+
+// multiply to 128 bits and fold the halves together
+static inline uint64_t mix(uint64_t a,uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128
+        r = (unsigned __int128)a * b;
+
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t
+        aHi = a >> 32,aLo = (uint32_t)a,
+        bHi = b >> 32,bLo = (uint32_t)b,
+        mid1 = aHi * bLo,
+        mid2 = aLo * bHi,
+        lo = aLo * bLo,
+        hi = aHi * bHi,
+        carry = ((lo >> 32) + (uint32_t)mid1 + (uint32_t)mid2) >> 32;
+
+    return (lo + (mid1 << 32) + (mid2 << 32)) ^ (hi + (mid1 >> 32) + (mid2 >> 32) + carry);
+#endif
 }
 
-void Dictionary::clear() {
-
-    for (uint32_t i=0;i<TABLE_SIZE;i++)
-        status[i] = UNUSED;
-
-    nItems = 0;
-}
-
-void Dictionary::add(const std::string &key,const Fraction value) {
-    // hash key to get a position
-    uint32_t
-        pos = hash(key) % TABLE_SIZE;
-
-    // sequential search for key
-    while (status[pos] != UNUSED) {
-
-        // if key found, update value and return
-        if (status[pos] == IN_USE && keys[pos] == key) {
-            values[pos] = value;
-            return;
-        }
-
-        pos = (pos + 1) % TABLE_SIZE;
+// wyhash style: the length goes in first, then the string is read eight bytes
+// at a time, each word folded in with one wide multiply
+uint32_t stringHash(const std::string &s) {
+    const char
+        *p = s.data();
+    size_t
+        n = s.length();
+    uint64_t
+        h = mix(HASH_SEED ^ n,HASH_P1),
+        w;
+
+    for (;n>=8;p+=8,n-=8) {
+        memcpy(&w,p,8);
+        h = mix(w ^ HASH_P1,h ^ HASH_P2);
     }
 
-    // not found... is table too full? If so, exception
-    if (nItems == MAX_ITEMS)
-        throw std::overflow_error("Dictionary is full");
-
-    // not too full... search again stopping at first open spot
-
-    // put key here, increment nItems and done
-}
-
-Fraction Dictionary::search(const std::string &key) {
-    // hash key to get a position
-
-    // sequential search for key; stop at unused
+    if (n > 0) {
+        w = 0;
+        memcpy(&w,p,n);
+        h = mix(w ^ HASH_P3,h ^ HASH_P2);
+    }
 
-        // if key found, return value
+    h = mix(h,HASH_P3);
 
-    // if we get here, key isn't here, throw exception
-    throw std::domain_error("Key not found");
+    return (uint32_t)(h ^ (h >> 32));
 }
 
-void Dictionary::remove(const std::string &) {
-    // hash key to get a position
-
-    // sequential search for key; stop at unused
-
-        // if key found, set status to deleted and return
+uint32_t simpleHash(const std::string &s) {
+    uint32_t
+        sum = 0;
 
-    // if we get here, key isn't here, throw exception
-    throw std::domain_error("Key not found");
+    for (uint32_t i=0;i<s.length();i++)
+        sum = sum * i + s[i];
 
+    return sum;
 }
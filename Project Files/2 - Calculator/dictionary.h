@@ -5,48 +5,462 @@
 #ifndef _DICTIONARY_H
 #define _DICTIONARY_H
 
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
 #include <string>
-#include "fraction.h"
+#include <functional>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-enum DictionaryStatus {
-    UNUSED,
-    IN_USE,
-    DELETED
+const uint32_t
+    INIT_TABLE_SIZE = 128,              // table sizes are powers of two
+    MAX_LOAD_PERCENT = 75,              // resize when used slots pass this
+    MIGRATE_STEP = 8,                   // old slots moved per operation while resizing
+    GROUP_SIZE = 16;                    // control bytes examined at once
+
+// each slot has a control byte: UNUSED, DELETED, or, for a slot in use, a
+// 7-bit tag taken from its key's hash. tags have the high bit clear, so
+// in-use slots are the ones with it clear
+const uint8_t
+    UNUSED = 0x80,
+    DELETED = 0xfe,
+    TAG_MASK = 0x7f;
+
+// bit i of the result is set if p[i] == b, for the GROUP_SIZE bytes at p
+inline uint32_t groupMatch(const uint8_t *p,uint8_t b) {
+#ifdef __SSE2__
+    __m128i
+        group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group,_mm_set1_epi8((char)b)));
+#else
+    uint32_t
+        bits = 0;
+
+    for (uint32_t i=0;i<GROUP_SIZE;i++)
+        if (p[i] == b)
+            bits |= 1u << i;
+
+    return bits;
+#endif
+}
+
+// bit i of the result is set if slot p[i] is not in use
+inline uint32_t groupFree(const uint8_t *p) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+#else
+    uint32_t
+        bits = 0;
+
+    for (uint32_t i=0;i<GROUP_SIZE;i++)
+        if (p[i] & 0x80)
+            bits |= 1u << i;
+
+    return bits;
+#endif
+}
+
+// string hashes. stringHash() reads eight bytes at a time and mixes each
+// word with a wide multiply; simpleHash() is the original
+// character-at-a-time sum, kept for comparison. it multiplies by zero at the
+// first character, so every key's hash depends only on its later characters
+uint32_t stringHash(const std::string &);
+uint32_t simpleHash(const std::string &);
+
+// hash policies: a function object taking a key and returning 32 bits,
+// passed as Dictionary's third template argument
+struct StringHash {
+    uint32_t operator()(const std::string &k) const { return stringHash(k); }
 };
 
-const uint32_t
-    TABLE_SIZE = 127,
-    MAX_ITEMS = 101;
+struct SimpleStringHash {
+    uint32_t operator()(const std::string &k) const { return simpleHash(k); }
+};
+
+// default policy; strings use StringHash, everything else std::hash
+template <typename KeyType>
+struct DictionaryHash {
+    uint32_t operator()(const KeyType &k) const {
+        return static_cast<uint32_t>(std::hash<KeyType>()(k));
+    }
+};
 
+template <>
+struct DictionaryHash<std::string> : StringHash { };
+
+// open addressing with linear probing. when the table gets too full a new one
+// twice the size is made and entries are moved over a few slots at a time by
+// later operations, so no single add pays for copying the whole table. until
+// the move is done, lookups check the new table first and then the old one.
+// removing from the current table shifts the rest of the probe run back
+// rather than leaving a tombstone, so churn can't lengthen probes; only the
+// old table, which is thrown away once empty, ever holds DELETED slots.
+// probes compare the control bytes of 16 slots at a time against the key's
+// tag and only look at keys[] where a tag matches, so a search for an absent
+// key rarely touches a key at all
+template <typename KeyType,typename ValueType,typename Hasher=DictionaryHash<KeyType>>
 class Dictionary {
 public:
-    Dictionary() { clear(); } // NOLINT(cppcoreguidelines-pro-type-member-init)
+    Dictionary() { clear(); }
     ~Dictionary() = default;
 
-    bool isEmpty() { return nItems == 0; }
-    uint32_t size() { return nItems; }
+    bool isEmpty() { return size() == 0; }
+    uint32_t size() { return cur.nItems + old.nItems; }
+
+    void clear() {
+
+        cur.reset(INIT_TABLE_SIZE);
+        old.reset(0);
+        migratePos = 0;
+    }
+
+    void add(const KeyType &key,const ValueType &value) {
+        bool
+            added;
+        ValueType
+            &slot = findOrAdd(key,value,added);
+
+        // if key found, update value
+        if (!added)
+            slot = value;
+    }
 
-    void clear();
+    // the value stored for key, adding key with value first if it isn't
+    // there; added says which happened. the key is hashed once, and a miss
+    // is placed where its search stopped. the reference is good until the
+    // next add or remove
+    ValueType &findOrAdd(const KeyType &key,const ValueType &value,bool &added) {
+        uint64_t
+            h = prvMix(key);
+        uint32_t
+            pos,
+            open,
+            oldOpen;
 
-    void add(const std::string &,const Fraction);
+        prvMigrate();
 
-    Fraction search(const std::string &);
+        pos = prvFind(cur,key,h,open);
+        if (pos != NOT_FOUND) {
+            added = false;
+            return cur.values[pos];
+        }
 
-    void remove(const std::string &);
+        added = true;
+
+        // a key still in the old table moves to the new one
+        pos = prvFind(old,key,h,oldOpen);
+        if (pos != NOT_FOUND) {
+            ValueType
+                moved = std::move(old.values[pos]);
+
+            added = false;
+            prvErase(old,pos);
+            return prvAdd(key,moved,h,open);
+        }
+
+        return prvAdd(key,value,h,open);
+    }
+
+    bool contains(const KeyType &key) {
+        return prvFind(cur,key) != NOT_FOUND || prvFind(old,key) != NOT_FOUND;
+    }
+
+    // like search(), but reports a missing key by returning false
+    bool lookup(const KeyType &key,ValueType &value) {
+        uint32_t
+            pos = prvFind(cur,key);
+
+        if (pos != NOT_FOUND) {
+            value = cur.values[pos];
+            return true;
+        }
+
+        pos = prvFind(old,key);
+        if (pos != NOT_FOUND) {
+            value = old.values[pos];
+            return true;
+        }
+
+        return false;
+    }
+
+    ValueType search(const KeyType &key) {
+        uint32_t
+            pos = prvFind(cur,key);
+
+        if (pos != NOT_FOUND)
+            return cur.values[pos];
+
+        pos = prvFind(old,key);
+        if (pos != NOT_FOUND)
+            return old.values[pos];
+
+        throw std::domain_error("Key not found");
+    }
+
+    void remove(const KeyType &key) {
+        uint32_t
+            pos;
+
+        prvMigrate();
+
+        pos = prvFind(cur,key);
+        if (pos != NOT_FOUND) {
+            prvShiftErase(cur,pos);
+            return;
+        }
+
+        pos = prvFind(old,key);
+        if (pos != NOT_FOUND) {
+            prvErase(old,pos);
+            return;
+        }
+
+        throw std::domain_error("Key not found");
+    }
+
+    // hist[d] is set to the number of keys found d+1 slots from where their
+    // hash puts them, i.e. the probe lengths of successful searches
+    void probeLengths(std::vector<uint32_t> &hist) {
+
+        hist.clear();
+        prvProbeLengths(cur,hist);
+        prvProbeLengths(old,hist);
+    }
 
 private:
-    std::string
-        keys[TABLE_SIZE];
-    Fraction
-        values[TABLE_SIZE];
-    DictionaryStatus
-        status[TABLE_SIZE];
+    static const uint32_t
+        NOT_FOUND = 0xffffffff;
+
+    struct Table {
+        std::vector<KeyType>
+            keys;
+        std::vector<ValueType>
+            values;
+        std::vector<uint8_t>
+            ctrl;                       // capacity bytes, then a copy of the
+                                        // first GROUP_SIZE-1 so groups can wrap
+        uint32_t
+            capacity,
+            nItems;
+
+        void reset(uint32_t cap) {
+            keys.assign(cap,KeyType());
+            values.assign(cap,ValueType());
+            ctrl.assign(cap ? cap + GROUP_SIZE - 1 : 0,UNUSED);
+            capacity = cap;
+            nItems = 0;
+        }
+
+        bool inUse(uint32_t pos) const { return (ctrl[pos] & 0x80) == 0; }
+
+        void setCtrl(uint32_t pos,uint8_t c) {
+            ctrl[pos] = c;
+            if (pos < GROUP_SIZE - 1)
+                ctrl[capacity + pos] = c;
+        }
+    };
+
+    Table
+        cur,
+        old;                            // being emptied into cur; capacity 0 if not resizing
     uint32_t
-        nItems;
+        migratePos;                     // next old slot to move
+    Hasher
+        hasher;
 
-};
+    // spread the hash over all bits; the high half picks the home slot and
+    // bits below it give the tag
+    uint64_t prvMix(const KeyType &key) {
+        return (uint64_t)hasher(key) * 0x9e3779b97f4a7c15ull;
+    }
+
+    uint32_t prvHome(const Table &t,uint64_t h) { return (uint32_t)(h >> 32) & (t.capacity - 1); }
+
+    uint8_t prvTag(uint64_t h) { return (uint8_t)(h >> 25) & TAG_MASK; }
+
+    uint32_t prvHome(const Table &t,const KeyType &key) { return prvHome(t,prvMix(key)); }
+
+    void prvProbeLengths(const Table &t,std::vector<uint32_t> &hist) {
+
+        for (uint32_t i=0;i<t.capacity;i++)
+            if (t.inUse(i)) {
+                uint32_t
+                    d = (i - prvHome(t,t.keys[i])) & (t.capacity - 1);
+
+                if (d >= hist.size())
+                    hist.resize(d + 1,0);
+                hist[d]++;
+            }
+    }
+
+    uint32_t prvFind(const Table &t,const KeyType &key) {
+        uint32_t
+            open;
+
+        return prvFind(t,key,prvMix(key),open);
+    }
+
+    // search a group at a time for slots whose tag matches, stopping at the
+    // first group with an unused slot; matches past that slot don't count.
+    // on a miss open is that unused slot, which is where prvPlace would put
+    // the key (or NOT_FOUND if the table is empty)
+    uint32_t prvFind(const Table &t,const KeyType &key,uint64_t h,uint32_t &open) {
+        uint32_t
+            pos,
+            match,
+            unused;
+        uint8_t
+            tag;
+
+        open = NOT_FOUND;
+        if (t.nItems == 0)
+            return NOT_FOUND;
+
+        tag = prvTag(h);
+
+        for (pos=prvHome(t,h);;pos=(pos+GROUP_SIZE)&(t.capacity-1)) {
+            match = groupMatch(&t.ctrl[pos],tag);
+            unused = groupMatch(&t.ctrl[pos],UNUSED);
+
+            if (unused != 0)
+                match &= (unused & -unused) - 1;
+
+            for (;match!=0;match&=match-1) {
+                uint32_t
+                    slot = (pos + __builtin_ctz(match)) & (t.capacity - 1);
+
+                if (t.keys[slot] == key)
+                    return slot;
+            }
+
+            if (unused != 0) {
+                open = (pos + __builtin_ctz(unused)) & (t.capacity - 1);
+                return NOT_FOUND;
+            }
+        }
+    }
+
+    // key, whose mixed hash is h, isn't in cur. open is where a search of
+    // cur stopped, which a resize makes stale
+    ValueType &prvAdd(const KeyType &key,const ValueType &value,uint64_t h,uint32_t open) {
+
+        if ((uint64_t)(cur.nItems + 1) * 100 > (uint64_t)cur.capacity * MAX_LOAD_PERCENT) {
+            prvStartResize();
+            open = NOT_FOUND;
+        }
+
+        return cur.values[prvPlace(cur,key,value,h,open)];
+    }
 
+    // key must not be in t; put it at the first open spot, or at pos if the
+    // caller already knows it. returns the slot used
+    uint32_t prvPlace(Table &t,const KeyType &key,const ValueType &value,uint64_t h,
+                      uint32_t pos=NOT_FOUND) {
+        uint32_t
+            open;
+
+        if (pos == NOT_FOUND) {
+            for (pos=prvHome(t,h);;pos=(pos+GROUP_SIZE)&(t.capacity-1)) {
+                open = groupFree(&t.ctrl[pos]);
+                if (open != 0)
+                    break;
+            }
+
+            pos = (pos + __builtin_ctz(open)) & (t.capacity - 1);
+        }
+
+        t.keys[pos] = key;
+        t.values[pos] = value;
+        t.setCtrl(pos,prvTag(h));
+        t.nItems++;
+
+        return pos;
+    }
+
+    // leave a tombstone; only for the old table, where moving entries would
+    // make the migration miss them
+    void prvErase(Table &t,uint32_t pos) {
+
+        t.keys[pos] = KeyType();
+        t.values[pos] = ValueType();
+        t.setCtrl(pos,DELETED);
+        t.nItems--;
+    }
+
+    // empty slot pos, then walk the rest of its probe run moving back any
+    // entry whose home isn't between the hole and where it sits, so every
+    // entry stays reachable from its home without crossing an unused slot
+    void prvShiftErase(Table &t,uint32_t pos) {
+        uint32_t
+            mask = t.capacity - 1,
+            next,
+            home;
+
+        for (next=(pos+1)&mask;t.ctrl[next]!=UNUSED;next=(next+1)&mask) {
+            home = prvHome(t,t.keys[next]);
+
+            // cyclically, home in (pos,next] means the entry can't move back
+            if (((next - home) & mask) < ((next - pos) & mask))
+                continue;
+
+            t.keys[pos] = std::move(t.keys[next]);
+            t.values[pos] = std::move(t.values[next]);
+            t.setCtrl(pos,t.ctrl[next]);
+            pos = next;
+        }
+
+        t.keys[pos] = KeyType();
+        t.values[pos] = ValueType();
+        t.setCtrl(pos,UNUSED);
+        t.nItems--;
+    }
+
+    // cur becomes the old table and a new, empty cur is made. a resize only
+    // starts once the previous one is finished
+    void prvStartResize() {
+        uint32_t
+            cap = cur.capacity;
+
+        // finish any move still in progress first
+        while (old.capacity != 0)
+            prvMigrate();
+
+        if (cap >= 0x80000000u)
+            throw std::overflow_error("Dictionary is full");
+
+        std::swap(old,cur);
+        cur.reset(cap * 2);
+        migratePos = 0;
+    }
+
+    // move the next few slots of the old table, if there is one. the new table
+    // is twice as big and gets at most 3/8 of it from the old one, so at
+    // MIGRATE_STEP slots per operation the old table is empty long before the
+    // new one is full enough to resize again
+    void prvMigrate() {
+        uint32_t
+            end;
+
+        if (old.capacity == 0)
+            return;
+
+        end = std::min(migratePos + MIGRATE_STEP,old.capacity);
+
+        for (;migratePos<end;migratePos++)
+            if (old.inUse(migratePos)) {
+                prvPlace(cur,old.keys[migratePos],old.values[migratePos],prvMix(old.keys[migratePos]));
+                prvErase(old,migratePos);
+            }
+
+        if (migratePos == old.capacity)
+            old.reset(0);
+    }
+};
 
 #endif //_DICTIONARY_H
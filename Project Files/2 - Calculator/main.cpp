@@ -1,14 +1,18 @@
 #include <iostream>
 #include "dictionary.h"
+#include "fraction.h"
+#include "symbolTable.h"
 
 int main() {
-    Dictionary
+    SymbolTable
+        symbols;
+    Dictionary<Symbol,ExactFraction>
         vars;
-    Fraction
+    ExactFraction
         f(2,3);
 
     try {
-        vars.add("foo", f);
+        vars.add(symbols.intern("foo"), f);
     }
     catch (const std::overflow_error &e) {
         std::cout << "Caught an overflow" << std::endl;
@@ -0,0 +1,125 @@
+//
+// Probe lengths and lookup times of Dictionary under each string hash
+//
+// usage: probeBench [word file]    (default: the Word Ladders sgb-words.txt)
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "dictionary.h"
+
+using namespace std;
+
+const uint32_t
+    N_NAMES = 20000,                    // synthetic calculator variable names
+    N_ROUNDS = 20,                      // lookups of every key per timing
+    HIST_SHOWN = 8;                     // probe lengths shown one by one
+
+template <typename Hasher>
+void report(const string &hashName,const vector<string> &keys) {
+    Dictionary<string,uint32_t,Hasher>
+        d;
+    vector<uint32_t>
+        hist;
+    vector<string>
+        absent;
+    uint64_t
+        total = 0,
+        sum = 0;
+
+    for (uint32_t i=0;i<keys.size();i++)
+        d.add(keys[i],i);
+
+    d.probeLengths(hist);
+
+    for (uint32_t i=0;i<hist.size();i++)
+        total += (uint64_t)hist[i] * (i + 1);
+
+    auto
+        start = chrono::steady_clock::now();
+
+    for (uint32_t r=0;r<N_ROUNDS;r++)
+        for (auto &k : keys)
+            sum += d.search(k);
+
+    auto
+        stop = chrono::steady_clock::now();
+
+    // same lengths and letters, but none of them are keys
+    for (auto &k : keys)
+        absent.push_back(k + "#");
+
+    auto
+        missStart = chrono::steady_clock::now();
+
+    for (uint32_t r=0;r<N_ROUNDS;r++)
+        for (auto &k : absent)
+            sum += d.contains(k);
+
+    auto
+        missStop = chrono::steady_clock::now();
+
+    // keep the searches from being optimized away
+    if (sum == 0)
+        cout << "";
+
+    cout << "  " << left << setw(8) << hashName << right
+         << "mean " << setw(6) << (double)total / keys.size()
+         << "  max " << setw(5) << hist.size()
+         << "  ns/hit " << setw(7)
+         << chrono::duration<double,nano>(stop - start).count() / ((double)N_ROUNDS * keys.size())
+         << "  ns/miss " << setw(7)
+         << chrono::duration<double,nano>(missStop - missStart).count() / ((double)N_ROUNDS * keys.size())
+         << "  probes:";
+
+    for (uint32_t i=0;i<HIST_SHOWN;i++)
+        cout << ' ' << (i < hist.size() ? hist[i] : 0);
+
+    uint64_t
+        rest = 0;
+
+    for (uint32_t i=HIST_SHOWN;i<hist.size();i++)
+        rest += hist[i];
+
+    cout << " " << HIST_SHOWN + 1 << "+:" << rest << endl;
+}
+
+void compare(const string &setName,const vector<string> &keys) {
+
+    cout << setName << ", " << keys.size() << " keys" << endl;
+    report<StringHash>("word",keys);
+    report<SimpleStringHash>("simple",keys);
+}
+
+int main(int argc,char *argv[]) {
+    string
+        fileName = (argc > 1) ? argv[1] : "../../3 - Word Ladders/sgb-words.txt",
+        word;
+    ifstream
+        inFile(fileName);
+    vector<string>
+        words,
+        names;
+
+    while (inFile >> word)
+        words.push_back(word);
+
+    if (words.empty()) {
+        cout << "Error: can't read words from " << fileName << endl;
+        return 1;
+    }
+
+    // names like a calculator session makes: short, shared prefixes
+    for (uint32_t i=0;i<N_NAMES;i++)
+        names.push_back(string(1,(char)('a' + i % 26)) + to_string(i / 26));
+
+    cout << fixed << setprecision(2);
+    compare(fileName,words);
+    compare("variable names",names);
+
+    return 0;
+}
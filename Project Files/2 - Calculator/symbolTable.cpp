@@ -0,0 +1,48 @@
+//
+// Interned names for the calculator's variables
+//
+
+#include "symbolTable.h"
+
+Symbol SymbolTable::intern(const std::string &name) {
+    bool
+        added;
+    Symbol
+        s = ids.findOrAdd(name,(Symbol)names.size(),added);
+
+    if (!added)
+        return s;
+
+    // a new name; take it back out if it can't have the symbol
+    try {
+        if (names.size() == NO_SYMBOL)
+            throw std::overflow_error("Symbol table is full");
+        names.push_back(name);
+    } catch (...) {
+        ids.remove(name);
+        throw;
+    }
+
+    return s;
+}
+
+Symbol SymbolTable::find(const std::string &name) {
+    Symbol
+        s;
+
+    return ids.lookup(name,s) ? s : NO_SYMBOL;
+}
+
+const std::string &SymbolTable::name(Symbol s) {
+
+    if (s >= names.size())
+        throw std::domain_error("Unknown symbol");
+
+    return names[s];
+}
+
+void SymbolTable::clear() {
+
+    ids.clear();
+    names.clear();
+}
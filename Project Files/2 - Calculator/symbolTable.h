@@ -0,0 +1,47 @@
+//
+// Interned names for the calculator's variables
+//
+
+#ifndef _SYMBOLTABLE_H
+#define _SYMBOLTABLE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "dictionary.h"
+
+// a symbol is a small integer standing for a name. each distinct name gets
+// one, in order, so comparing or hashing symbols is comparing or hashing an
+// integer, and a Dictionary<Symbol,...> never touches the names at all
+typedef uint32_t Symbol;
+
+const Symbol
+    NO_SYMBOL = 0xffffffff;
+
+class SymbolTable {
+public:
+    SymbolTable() = default;
+    ~SymbolTable() = default;
+
+    uint32_t size() { return (uint32_t)names.size(); }
+
+    // symbol for name, giving it a new one if it doesn't have one yet
+    Symbol intern(const std::string &name);
+
+    // symbol for name, or NO_SYMBOL if it hasn't been interned
+    Symbol find(const std::string &name);
+
+    // the name a symbol stands for
+    const std::string &name(Symbol s);
+
+    void clear();
+
+private:
+    Dictionary<std::string,Symbol>
+        ids;
+    std::vector<std::string>
+        names;
+};
+
+#endif //_SYMBOLTABLE_H